@@ -5,6 +5,7 @@
 #-------------------------------------------------
 
 QT       += core widgets
+CONFIG   += c++17
 
 TARGET = Visual6502
 TEMPLATE = app
@@ -13,13 +14,53 @@ TEMPLATE = app
 SOURCES += main.cpp\
         mainwindow.cpp \
     ../cpu/cpu.cpp \
+    ../cpu/decimal.cpp \
+    ../cpu/scheduler.cpp \
+    ../cpu/pacer.cpp \
+    ../cpu/cpu65c02.cpp \
+    ../cpu/undocumented.cpp \
+    ../cpu/opinfo.cpp \
+    ../cpu/profiler.cpp \
+    ../cpu/pcprofiler.cpp \
     ../assembler/assembler.cpp \
-    ../mmc/basicmemory.cpp
+    ../assembler/lexer.cpp \
+    ../assembler/symboltable.cpp \
+    ../assembler/preprocessor.cpp \
+    ../assembler/linker.cpp \
+    ../assembler/incremental.cpp \
+    ../assembler/expression.cpp \
+    ../mmc/basicmemory.cpp \
+    ../mmc/memorycounters.cpp \
+    ../trace/tracewriter.cpp \
+    ../trace/linemapreader.cpp \
+    ../trace/lz.cpp
 
 HEADERS  += mainwindow.h \
     ../cpu/cpu.h \
+    ../cpu/decimal.h \
+    ../cpu/scheduler.h \
+    ../cpu/pacer.h \
+    ../cpu/variants.h \
+    ../cpu/opinfo.h \
+    ../cpu/profiler.h \
+    ../cpu/pcprofiler.h \
     ../common/common.h \
     ../assembler/assembler.h \
-    ../mmc/basicmemory.h
+    ../assembler/lexer.h \
+    ../assembler/mnemonics.h \
+    ../assembler/arena.h \
+    ../assembler/symboltable.h \
+    ../assembler/objectmodule.h \
+    ../assembler/preprocessor.h \
+    ../assembler/linker.h \
+    ../assembler/incremental.h \
+    ../assembler/expression.h \
+    ../mmc/basicmemory.h \
+    ../mmc/instrumentedmemory.h \
+    ../trace/tracewriter.h \
+    ../trace/tracerecord.h \
+    ../trace/linemap.h \
+    ../trace/linemapreader.h \
+    ../trace/lz.h
 
 FORMS    += mainwindow.ui
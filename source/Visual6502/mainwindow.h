@@ -13,7 +13,7 @@
 #include <QtConcurrent/QtConcurrentRun>
 #include <stdlib.h>
 #include <time.h>
-#include "../assembler/assembler.h"
+#include "../assembler/incremental.h"
 #include "../cpu/cpu.h"
 #include "../mmc/basicmemory.h"
 
@@ -51,7 +51,7 @@ private:
     void execute();
     unsigned short lastMem;
     Ui::MainWindow *ui;
-    Assembler   asmber;
+    IncrementalAssembler asmber;    //keeps its cache between Assemble clicks
     CPU*        theCpu;
     BasicMemory theMem;
     stringstream superSS;
@@ -0,0 +1,73 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <vector>
+#include <new>
+#include <type_traits>
+#include <stdlib.h>
+
+using namespace std;
+
+#define ARENA_BLOCK_SIZE 65536
+
+//Bump allocator for the assembler's per-run records. Blocks are kept
+//between runs, reset() just rewinds to the first one. Nothing allocated
+//here gets its destructor run, so only trivially destructible types go in.
+class Arena
+{
+public:
+    Arena() : current(0), used(0) {}
+    ~Arena()
+    {
+        for(size_t i = 0; i < blocks.size(); i++)
+            free(blocks[i].data);
+    }
+
+    void* allocate(size_t size, size_t align = sizeof(void*))
+    {
+        while(current < blocks.size())
+        {
+            size_t start = (used + align - 1) & ~(align - 1);
+            if(start + size <= blocks[current].size)
+            {
+                used = start + size;
+                return blocks[current].data + start;
+            }
+            current++;      //rest of this block is wasted until the next reset
+            used = 0;
+        }
+        Block block;
+        block.size = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+        block.data = (char*)malloc(block.size);
+        blocks.push_back(block);
+        used = size;
+        return block.data;
+    }
+
+    template<class T, class... Args>
+    T* make(Args... args)
+    {
+        static_assert(is_trivially_destructible<T>::value, "arena objects are never destroyed");
+        return new(allocate(sizeof(T), alignof(T))) T{args...};
+    }
+
+    void reset()
+    {
+        current = 0;
+        used = 0;
+    }
+
+private:
+    class Block
+    {
+    public:
+        char*  data;
+        size_t size;
+    };
+
+    vector<Block> blocks;
+    size_t current;     //block we're allocating from
+    size_t used;        //bytes used in the current block
+};
+
+#endif // ARENA_H
@@ -1,94 +1,164 @@
+#include <iomanip>
 #include "assembler.h"
+#include "../cpu/opinfo.h"
+#include "../trace/linemap.h"
 
-bool contains(string& toCheck, char target)
+//An operand picked apart, before we know which opcode it goes with.
+class Operand
 {
-    return !(toCheck.find(target) == string::npos);
+public:
+    byte        mode;       //IMP, IMM, IND, IDX, IDY, or ABS/ABX/ABY for plain addresses
+    ExprInfo    info;       //the expression, compiled into LineRef::expr
+};
+
+static string_view trim(string_view text)
+{
+    while(!text.empty() && isSpace(text.front()))
+        text.remove_prefix(1);
+    while(!text.empty() && isSpace(text.back()))
+        text.remove_suffix(1);
+    return text;
 }
 
-string StringToUpper(string strToConvert)
+static bool equalsNoCase(string_view text, const char* upper)
 {
-    std::transform(strToConvert.begin(), strToConvert.end(), strToConvert.begin(), ::toupper);
+    size_t i = 0;
+    for(; i < text.size() && upper[i]; i++)
+    {
+        if(toUpper(text[i]) != upper[i])
+            return false;
+    }
+    return i == text.size() && !upper[i];
+}
 
-    return strToConvert;
+static string upperKey(string_view text)
+{
+    string key(text.size(), ' ');
+    for(size_t i = 0; i < text.size(); i++)
+        key[i] = toUpper(text[i]);
+    return key;
 }
 
-vector<string> inline SplitString(const string& source, const char *delimiter = " ", bool keepEmpty = false)
+//an operand that starts with ( is indirect, [ ] groups an expression there
+static bool parseOperand(string_view text, Operand& op, vector<byte>& code, const LabelBinder& bind, string& error)
 {
-    vector<string> results;
+    op.mode = IMP;
+    op.info = ExprInfo{false, false, false, 0};
+
+    text = trim(text);
+    if(text.empty() || equalsNoCase(text, "A"))
+        return true; //implied or accumulator
 
-    size_t prev = 0;
-    size_t next = 0;
+    if(text[0] == '#')
+    {
+        op.mode = IMM;
+        return compileExpression(trim(text.substr(1)), code, bind, op.info, error);
+    }
 
-    while ((next = source.find_first_of(delimiter, prev)) != string::npos)
+    if(text[0] == '(')
     {
-        if (keepEmpty || (next - prev != 0))
+        //the matching ), the expression can have brackets of its own
+        size_t close = 1;
+        for(int depth = 1; close < text.size(); close++)
+        {
+            if(text[close] == '(')
+                depth++;
+            else if(text[close] == ')' && --depth == 0)
+                break;
+        }
+        if(close >= text.size())
+        {
+            error = "Missing ')' in " + string(text);
+            return false;
+        }
+        string_view inner = trim(text.substr(1, close - 1));
+        string_view after = trim(text.substr(close + 1));
+        size_t comma = inner.find(',');
+        if(comma != string_view::npos)
+        {
+            //($xx,X)
+            if(!equalsNoCase(trim(inner.substr(comma + 1)), "X") || !after.empty())
+            {
+                error = "Bad indexed indirect operand " + string(text);
+                return false;
+            }
+            op.mode = IDX;
+            inner = trim(inner.substr(0, comma));
+        }
+        else if(after.empty())
         {
-            results.push_back(source.substr(prev, next - prev));
+            op.mode = IND;
         }
-        prev = next + 1;
+        else if(after[0] == ',' && equalsNoCase(trim(after.substr(1)), "Y"))
+        {
+            op.mode = IDY;
+        }
+        else
+        {
+            error = "Bad indirect operand " + string(text);
+            return false;
+        }
+        return compileExpression(inner, code, bind, op.info, error);
     }
 
-    if (prev < source.size())
+    op.mode = ABS;
+    size_t comma = text.find(',');
+    if(comma != string_view::npos)
     {
-        results.push_back(source.substr(prev));
+        string_view index = trim(text.substr(comma + 1));
+        if(equalsNoCase(index, "X"))
+            op.mode = ABX;
+        else if(equalsNoCase(index, "Y"))
+            op.mode = ABY;
+        else
+        {
+            error = "Bad index register " + string(index);
+            return false;
+        }
+        text = trim(text.substr(0, comma));
     }
+    return compileExpression(text, code, bind, op.info, error);
+}
 
-    return results;
+//line is in the text the Lexer saw, which may be the preprocessor's output
+string Assembler::lineError(int line, string message)
+{
+    return preprocessor.location(line) + ": " + message;
 }
 
-short extractValue(string toExtract)
+//note an operand to patch once every label is known
+void Assembler::addFixup(int line)
 {
-    stringstream ss;
-    short value = -1;
-    
-    if(toExtract[0] == '$') //hex value
-    {
-        ss << hex << toExtract.substr(1, toExtract.length()-1);
-        ss >> value;
-    }
-    else
+    byte* code = (byte*)arena.allocate(lineRef.expr.size(), 1);
+    memcpy(code, lineRef.expr.data(), lineRef.expr.size());
+    fixups = arena.make<Fixup>(code, (unsigned short)lineRef.expr.size(), (unsigned short)currentPC,
+                               lineRef.kind, lineRef.relax, lineRef.longOpcode, (byte)1, line, fixups);
+    if(lineRef.relax != RELAX_NONE)
     {
-       ss << toExtract;
-       ss >> value;
+        relaxable.push_back(fixups);
+        relaxableAt.push_back(currentCode.size());
     }
-    return value;
-    
 }
 
-sbyte Assembler::calculateBranch(short addr, short branchAddr)
+static LabelHandle bindSymbol(void* labels, string_view name)
 {
-    short tmpAddr = branchAddr;
-    //branch is after us, need to jump forward
-    if(tmpAddr - addr > 0xFF)
-    {
-        errorStack.push("Branch target is out of range!");
-        return tmpAddr - addr;
-    }
-    if(addr < tmpAddr) // branch target is ahead of current PC
-        return tmpAddr-addr;
-    else
-        return tmpAddr - (addr+2); //branch target is behind, need to account for instruction loading
+    return (LabelHandle)((SymbolTable*)labels)->insert(name);
 }
 
-short Assembler::getLabel(string toCheck)
+static bool lookupSymbol(LabelHandle handle, int& value)
 {
-    map<string, short>::iterator it;
-    string tmp = StringToUpper(toCheck);
-    if(isdigit(toCheck[0]))
-        return -1;  //No numeric labels, damnit 
-    
-    it = labelMap.find(tmp);
-    if(it != labelMap.end())
-        return (it->second);
-        
-    return -1;
+    const Symbol* symbol = (const Symbol*)handle;
+    value = (unsigned short)symbol->value;
+    return symbol->defined;
 }
 
-Assembler::Assembler()
+Assembler::Assembler() : labels(&arena)
 {
     this->currentPC = 0;
     this->offset = 0;
-    this->loadTable();
+    this->fixups = 0;
+    this->relocatable = false;
+    this->binder = LabelBinder{bindSymbol, &labels};
     byteCounts[IMP] = 1;
     byteCounts[IMM] = 2;
     byteCounts[ZP]  = 2;
@@ -103,485 +173,470 @@ Assembler::Assembler()
     byteCounts[REL] = 2;
 }
 
-void Assembler::setEntry(byte opCode, byte addrMode, string inst)
+bool Assembler::createLabel(string_view label)
 {
-    map<string, byte*>::iterator it;
-
-    it = opTable.find(inst);
-    if(it != opTable.end())
+    Symbol* symbol = labels.insert(label);
+    if(symbol->defined)
     {
-        (it->second)[addrMode] = opCode;
-    }
-    else
-    {
-        byte* tmp = (byte*)malloc(12 * sizeof(byte));
-        memset(tmp, 0, 12*sizeof(byte));
-        tmp[addrMode] = opCode;
-        (opTable[inst]) = tmp;
+        errorStack.push("Label " + string(label) + " already exists, not redefining");
+        return false;
     }
-    return;
+    symbol->value = currentPC; //Where the code should start
+    symbol->defined = true;
+    placed.push_back(symbol);
+    placedAt.push_back(currentCode.size());
+    return true;
 }
 
-bool Assembler::createLabel(string label)
+bool Assembler::isInstruction(string_view toCheck)
 {
-    string tmp = StringToUpper(label);
-    if(getLabel(tmp) > 0)
-    {
-        errorStack.push("Label " + label + " already exists, not redefining");
-        return false;
-    }
-    labelMap[tmp] = currentPC; //Where the code should start, could be -1 if unresolved.
-    return true; 
+    return findMnemonic(toCheck) != 0;
 }
 
-bool Assembler::isInstruction(string& toCheck)
+//Operands start short. Each pass places the labels for what has grown so
+//far, then grows every short operand that doesn't fit. Nothing shrinks
+//again, so it ends, at the latest once everything is long.
+void Assembler::relaxOperands(ObjectModule* module)
 {
-    string tmp = StringToUpper(toCheck);
-    
-    map<string, byte*>::iterator it = opTable.find(tmp);
-    if(it == opTable.end())
-        return false;
-    
-    return true;
+    if(relaxable.empty())
+        return;
+
+    //shift[i] is how far relaxable[i] has moved, shift.back() the total
+    vector<unsigned int> shift(relaxable.size() + 1, 0);
+    vector<bool> wide(relaxable.size(), false);
+    vector<size_t> grow;
+    for(;;)
+    {
+        placeLabels(shift);
+        grow.clear();
+        for(size_t i = 0; i < relaxable.size(); i++)
+        {
+            if(!wide[i] && !fits(relaxable[i], relaxable[i]->address + shift[i], module))
+                grow.push_back(i);
+        }
+        if(grow.empty())
+            break;
+        for(size_t g = 0; g < grow.size(); g++)
+            wide[grow[g]] = true;
+        for(size_t i = 0; i < relaxable.size(); i++)
+            shift[i + 1] = shift[i] + (wide[i] ? growth(relaxable[i]->relax) : 0);
+    }
+    if(shift.back())
+        widenOperands(shift, wide);
 }
 
-/*int Assembler::resolveLabels()
+//how far code at this position (before anything grew) has moved
+unsigned int Assembler::shiftAt(const vector<unsigned int>& shift, unsigned int position)
 {
-    map<string, short>::iterator it;
-    string curKey;
+    size_t lo = 0;
+    size_t hi = relaxable.size();
+    while(lo < hi)
+    {
+        size_t mid = (lo + hi) / 2;
+        if(relaxableAt[mid] < position)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return shift[lo];
+}
 
+void Assembler::placeLabels(const vector<unsigned int>& shift)
+{
+    for(size_t i = 0; i < placed.size(); i++)
+        placed[i]->value = offset + placedAt[i] + shiftAt(shift, placedAt[i]);
+}
 
-    for(it = unresolvedLabelMap.begin(); it != unresolvedLabelMap.end(); ++it)
+bool Assembler::fits(const Fixup* fixup, unsigned short address, ObjectModule* module)
+{
+    int value;
+    if(module)
+    {
+        //the module's load address isn't known, only a byte of it fits zero page
+        RelocValue reloc;
+        if(evaluateRelocatable(fixup->code, fixup->length, address, lookupSymbol, reloc) != EVAL_OK)
+            return true;    //resolveLabels() reports it
+        //nor is the distance to another module, so branches there are long
+        if(reloc.part)
+            return true;
+        if(reloc.import)
+            return false;
+        if(!reloc.base && fixup->relax == RELAX_BRANCH)
+            return true;    //resolveLabels() says it needs a label
+        if(reloc.base && fixup->relax == RELAX_ZP)
+            return false;
+        value = reloc.value;
+    }
+    else
     {
-        curKey = (it->first);
-        short targetAddr = (it->second) - offset;
-        short tmpAddr = getLabel(curKey);
+        LabelHandle missing;
+        if(evaluateExpression(fixup->code, fixup->length, address, lookupSymbol, value, missing) != EVAL_OK)
+            return true;    //resolveLabels() reports it
+    }
+    return fitsShort(fixup->relax, value, address);
+}
 
-        if(tmpAddr == -1)
+//rewrite the code with the long forms and move every fixup along
+void Assembler::widenOperands(const vector<unsigned int>& shift, const vector<bool>& wide)
+{
+    vector<byte> code;
+    code.reserve(currentCode.size() + shift.back());
+    size_t from = 0;
+    for(size_t i = 0; i < relaxable.size(); i++)
+    {
+        Fixup* fixup = relaxable[i];
+        size_t at = relaxableAt[i];
+        code.insert(code.end(), currentCode.begin() + from, currentCode.begin() + at);
+        byte longForm[5];
+        if(wide[i])
         {
-            errorStack.push("Couldn't resolve unknown label: " + curKey);
-            return -1;
+            int size = widen(&currentCode[at], fixup->relax, fixup->longOpcode, longForm);
+            code.insert(code.end(), longForm, longForm + size);
+            fixup->operand = size - 2;
+            fixup->kind = REF_ABS;
         }
-        byte high = (tmpAddr >> 8) & 0xFF;
-        byte low = (tmpAddr) & 0xFF;
-        currentCode[++targetAddr] = low;   //IN PLACE CODE EDITING
-        currentCode[++targetAddr] = high;
+        else
+            code.insert(code.end(), currentCode.begin() + at, currentCode.begin() + at + 2);
+        from = at + 2;
     }
+    code.insert(code.end(), currentCode.begin() + from, currentCode.end());
+    currentCode.swap(code);
 
-    for(it = unresolvedBranchMap.begin(); it != unresolvedBranchMap.end(); ++it)
+    for(Fixup* fixup = fixups; fixup; fixup = fixup->next)
+        fixup->address += shiftAt(shift, (unsigned short)(fixup->address - offset));
+    for(size_t i = 0; i < listing.size(); i++)
     {
-        curKey = (it->first);
-        short targetBranch = (it->second) - offset;
-        short tmpAddr = getLabel(curKey);
-
-        if(tmpAddr == -1)
-        {
-            errorStack.push("Couldn't resolve unknown label " + curKey + " for branch!");
-            return -1;
-        }
-        byte branch = calculateBranch(targetBranch+1, tmpAddr-1);
-        currentCode[++targetBranch] = branch;
+        unsigned int at = listing[i].position;
+        unsigned int moved = shiftAt(shift, at);
+        listing[i].size += shiftAt(shift, at + listing[i].size) - moved;
+        listing[i].position = at + moved;
     }
-    return 0;
-}*/
+}
+
+bool Assembler::fitsShort(byte relax, int value, unsigned short address)
+{
+    if(relax == RELAX_ZP)
+        return value >= 0 && value <= 0xFF;
+    //offset is relative to the instruction after the branch
+    int branch = (unsigned short)value - (unsigned short)(address + 2);
+    return branch >= -128 && branch <= 127;
+}
 
-int Assembler::resolveLabels()
+int Assembler::growth(byte relax)
 {
-    //pop each item off the stack
-    UnLabelEntry* entPtr;
-    string curKey;
-    short targetAddr = 0;
-    short tmpAddr = 0;
+    return (relax == RELAX_BRANCH) ? 3 : 1;
+}
 
-    while(!unresolvedLabelStack.empty())
+int Assembler::widen(const byte* code, byte relax, byte longOpcode, byte* out)
+{
+    if(relax == RELAX_BRANCH)
+    {
+        //branch opcodes come in pairs $20 apart, the other one of the pair
+        //skips over the JMP
+        out[0] = code[0] ^ 0x20;
+        out[1] = 3;
+        out[2] = findMnemonic("JMP")->opCodes[ABS];
+        out[3] = 0;
+        out[4] = 0;
+        return 5;
+    }
+    out[0] = longOpcode;
+    out[1] = 0;
+    out[2] = 0;
+    return 3;
+}
+
+//module is only given when assembling relocatable code, labels that
+//aren't defined become imports instead of errors.
+int Assembler::resolveLabels(ObjectModule* module)
+{
+    for(Fixup* fixup = fixups; fixup; fixup = fixup->next)
     {
-        entPtr = unresolvedLabelStack.top();
-        curKey = entPtr->labelName;
-        targetAddr = entPtr->targetAddress - offset;
-        tmpAddr = getLabel(curKey);
-        if(tmpAddr == -1)
+        byte* operand = &currentCode[(unsigned short)(fixup->address - offset) + fixup->operand];
+        string error;
+        bool ok;
+        if(module)
+            ok = relocate(module, fixup, operand, error);
+        else
         {
-            errorStack.push("Couldn't resolve unkown label " + curKey);
-            return -1;
+            int value;
+            LabelHandle missing;
+            byte status = evaluateExpression(fixup->code, fixup->length, fixup->address, lookupSymbol, value, missing);
+            if(status == EVAL_UNDEFINED)
+                error = "Couldn't resolve unkown label " + string(((const Symbol*)missing)->name);
+            else if(status == EVAL_DIVZERO)
+                error = "Division by zero";
+            ok = status == EVAL_OK && patchOperand(operand, fixup->kind, value, fixup->address, error);
         }
-
-        byte high = (tmpAddr >> 8) & 0xFF;
-        byte low = (tmpAddr) & 0xFF;
-        currentCode[++targetAddr] = low;
-        currentCode[++targetAddr] = high;
-        unresolvedLabelStack.pop();
-    }
-
-    while(!unresolvedBranchStack.empty())
-    {
-        entPtr = unresolvedBranchStack.top();
-        curKey = entPtr->labelName;
-        targetAddr = entPtr->targetAddress - offset;
-        tmpAddr = getLabel(curKey);
-        if(tmpAddr == -1)
+        if(!ok)
         {
-            errorStack.push("Couldn't resolve unkown label " + curKey + " for branch");
+            errorStack.push(lineError(fixup->line, error));
             return -1;
         }
-
-        sbyte branch = calculateBranch((entPtr->targetAddress)+1, tmpAddr-1);
-        currentCode[++targetAddr] = branch;
-        unresolvedBranchStack.pop();
     }
     return 0;
 }
 
-//return bytes generated
-int Assembler::decodeLine(string toDecode)
-{
-    //Getting a line to decode.
-    vector<string> tokens = SplitString(toDecode);
-    //did we get anything?
-    string& curString = tokens[0];
-    byte currentToken = 0;
-    byte lastToken = tokens.size();
-    //byte addrMode = -1;
-    byte* opCodes = NULL;
-    
-    if(!tokens.size())
-    {
-        //we didn't get anything
-        //errorStack.push("Couldn't tokenize given line!");
-        return 0;
-    }
-    if(curString[0] == '\t')
-    {
-        //could be part of the string
-        if(curString.length() > 1)
-        {
-            curString = curString.substr(1, curString.length() -1);
-        }
-        //get the next one
-        else if((lastToken - (currentToken+1)))
-        {
-            currentToken++;
-            curString = tokens[currentToken];
-        }
-        else
+//Patch what doesn't move with the module, the rest becomes a relocation
+bool Assembler::relocate(ObjectModule* module, const Fixup* fixup, byte* operand, string& error)
+{
+    RelocValue value;
+    byte status = evaluateRelocatable(fixup->code, fixup->length, fixup->address, lookupSymbol, value);
+    if(status != EVAL_OK)
+    {
+        error = (status == EVAL_DIVZERO) ? "Division by zero" : "Expression can't be relocated, only label + or - a constant can";
+        return false;
+    }
+    if(!value.base && !value.import)
+    {
+        if(fixup->kind == REF_BRANCH)
         {
-            return 0; //no more tokens
+            error = "Branches to a fixed address need a fixed origin, use a label";
+            return false;
         }
+        return patchOperand(operand, fixup->kind, value.value, fixup->address, error);
+    }
+    if(fixup->kind == REF_BRANCH && !value.import && !value.part)
+        return patchOperand(operand, REF_BRANCH, value.value, fixup->address, error); //both inside the module
+
+    Relocation reloc;
+    reloc.offset = fixup->address + fixup->operand;
+    reloc.addend = value.value;
+    if(value.part)
+        reloc.kind = (value.part == EXPR_LOW) ? RELOC_LO8 : RELOC_HI8;
+    else if(fixup->kind == REF_BRANCH)
+        reloc.kind = RELOC_REL8;
+    else if(fixup->kind == REF_ABS)
+        reloc.kind = RELOC_ABS16;
+    else
+    {
+        error = "A relocatable address doesn't fit in a byte, use < or >";
+        return false;
     }
-    if(contains(curString, '\t'))
+    if(fixup->kind == REF_BRANCH && reloc.kind != RELOC_REL8)
     {
-        //we're past the first element
-        curString = curString.substr(0, curString.find('\t'));
+        error = "Branch target can't be a byte of an address";
+        return false;
     }
-    if(curString[0] == ';')
+    if(value.import)
     {
-        //we have a comment, ignore the rest.
-        return 0;
+        reloc.symbol = ((const Symbol*)value.import)->name;
+        if(find(module->imports.begin(), module->imports.end(), reloc.symbol) == module->imports.end())
+            module->imports.push_back(reloc.symbol);
     }
+    module->relocs.push_back(reloc);
+    return true;
+}
 
-    if(curString[curString.length()-1] == ':')
+//Write a value into the operand bytes that follow an opcode
+bool Assembler::patchOperand(byte* operand, byte kind, int value, unsigned short address, string& error)
+{
+    switch(kind)
     {
-        //we're defining a label
-        createLabel(curString.substr(0, curString.length()-1));
-        if((lastToken - (currentToken+1)))
+    case REF_BRANCH:
+    {
+        //offset is relative to the instruction after the branch
+        int branch = (unsigned short)value - (unsigned short)(address + 2);
+        if(branch < -128 || branch > 127)
         {
-            currentToken++;
-            curString = tokens[currentToken];
-            if(curString[0] == ';')
-                return 0;
+            error = "Branch target is out of range!";
+            return false;
         }
-        else
+        operand[0] = (sbyte)branch;
+        break;
+    }
+    case REF_ZP:
+        if(value < 0 || value > 0xFF)
         {
-            //Only this is in the line
-            return 0;
+            error = "Zero page operand is out of range";
+            return false;
         }
+        operand[0] = (byte)value;
+        break;
+    case REF_BYTE:
+        operand[0] = (byte)(value & 0xFF);
+        break;
+    default:
+        operand[0] = (byte)(value & 0xFF);
+        operand[1] = (byte)((value >> 8) & 0xFF);
+        break;
     }
-    
-    if(!isInstruction(curString))
+    return true;
+}
+
+//Encodes one line without looking at labels or the PC, so the result only
+//depends on the text. Operands that need them are left as zero bytes and
+//compiled into ref. Returns the size, or -1 with the reason in error.
+int Assembler::encodeLine(const SourceLine& line, byte* out, LineRef& ref, string& error, const LabelBinder& bind)
+{
+    ref.kind = REF_NONE;
+    ref.expr.clear();
+    ref.relax = RELAX_NONE;
+    ref.longOpcode = 0;
+    if(line.mnemonic.empty() || equalsNoCase(line.mnemonic, ".EXPORT"))
+        return 0; //blank, comment or label only. decodeLine() collects exports
+
+    const MnemonicRow* inst = findMnemonic(line.mnemonic);
+    if(!inst)
     {
-        errorStack.push("Didn't recognize " + curString + " as an instruction!");
-        //we don't have an instruction
-        //so panic
+        error = "Didn't recognize " + upperKey(line.mnemonic) + " as an instruction!";
         return -1;
     }
-    //figure out what the rest of the string is.
-    string opStr = StringToUpper(curString);
-    opCodes = opTable.find(opStr)->second;
-    
-    if((lastToken - (currentToken+1)))
-    {
-        currentToken++;
-        curString = tokens[currentToken];
+    const byte* opCodes = inst->opCodes;
 
-        if(contains(curString, '\t'))
-        {
-            //we're past the first element
-            curString = curString.substr(0, curString.find('\t'));
-        }
-    }
-    else
-    {
-        //implied instruction
-        //addrMode = IMP;
-        if(!opCodes[IMP] && curString != "BRK")
-        {
-            errorStack.push("Illegal address mode IMP for " + opStr);
-            return -1;
-        }
-        currentCode.push_back(opCodes[IMP]); //push back the instruction
-        return 1;
-    }
-    //we have an operand
-    if(curString[0] == 'A' || curString[0] == ';')
+    Operand op;
+    if(!parseOperand(line.operand, op, ref.expr, bind, error))
+        return -1;
+    bool constant = !op.info.labels && !op.info.pc;
+    int value = constant ? op.info.value : 0;
+
+    switch(op.mode)
     {
-        //accumulator
-        if(!opCodes[IMP] && opStr != "BRK")
-        {
-            errorStack.push("Illegal address mode IMP for " + opStr);
-            return -1;
-        }
-        currentCode.push_back(opCodes[IMP]); 
+    case IMP:
+        if(!inst->has(IMP))
+            break;
+        out[0] = opCodes[IMP];
         return 1;
-    }
-    if(curString[0] == '#' || isdigit(curString[0]))
-    {
-        if(curString[0] == '#')
-            curString = curString.substr(1);
-        //immediate
-        byte value;
-        
-        if(!opCodes[IMM] && curString.length() > 1)
+
+    case IMM:
+        if(!inst->has(IMM))
+            break;
+        out[0] = opCodes[IMM];
+        out[1] = (byte)(value & 0xFF);
+        if(!constant)
+            ref.kind = REF_BYTE;
+        return 2;
+
+    case IDX:
+    case IDY:
+        if(!inst->has(op.mode))
+            break;
+        if(value < 0 || value > 0xFF)
         {
-            errorStack.push("Illegal address mode IMM for " + opStr);
+            error = "Indirect indexed operands need a zero page address";
             return -1;
         }
-        
-        //could be a label NOT SUPPORTED in this assembler!
-
-        value = extractValue(curString);
-        currentCode.push_back(opCodes[IMM]);
-        currentCode.push_back((byte)(value & 0xFF));
+        out[0] = opCodes[op.mode];
+        out[1] = (byte)value;
+        if(!constant)
+            ref.kind = REF_ZP;
         return 2;
+
+    default:
+        break;
     }
-    if(contains(curString, ',') && (contains(curString, 'X') || contains(curString,'x')))
+
+    if(op.mode == ABS && inst->has(REL))
     {
-        //could be ZPX, ABX or IDX
-        if(contains(curString,'('))
-        {
-            //IDX
-            string tmp = curString.substr(1, 3); //this is assuming $ will always have two digits
-            if(!opCodes[IDX])
-            {
-                errorStack.push("Illegal address mode IDX for " + opStr);
-                return -1;
-            }
-            byte value = (byte)extractValue(tmp) & 0xFF;
-            currentCode.push_back(opCodes[IDX]);
-            currentCode.push_back(value);
-            return 2;
-        }
-        curString = curString.substr(0, curString.find(','));
-        if(curString.length() > 3)
-        {
-            //ABX
-            if(!opCodes[ABX])
-            {
-                errorStack.push("Illegal address mode ABX for " + opStr);
-                return -1;
-            }
-            short value = extractValue(curString);
-            byte high = (value >> 8) & 0xFF;
-            byte low = (value) & 0xFF;
-            currentCode.push_back(opCodes[ABX]);
-            currentCode.push_back(low);
-            currentCode.push_back(high);
-            return 3;
-        }
-        else
-        {
-            //ZPX
-            if(!opCodes[ZPX])
-            {
-                errorStack.push("Illegal address mode ZPX for " + opStr);
-                return -1;
-            }
-            byte value = (byte)extractValue(curString) & 0xFF;
-            currentCode.push_back(opCodes[ZPX]);
-            currentCode.push_back(value);
-            return 2;
-        }
+        //relative + branch, even a fixed target needs the PC
+        ref.kind = REF_BRANCH;
+        ref.relax = RELAX_BRANCH;
+        out[0] = opCodes[REL];
+        out[1] = 0;
+        return 2;
     }
-    if(contains(curString, ',') && (contains(curString, 'Y') || contains(curString, 'y')))
+
+    if(op.mode == ABS || op.mode == ABX || op.mode == ABY || op.mode == IND)
     {
-        //could be ZPY, ABY or IDY
-        if(contains(curString,'('))
+        //numbers written short use zero page when the instruction has it.
+        //So do label expressions, until the labels show they don't fit.
+        byte zeroMode = (op.mode == ABX) ? ZPX : (op.mode == ABY) ? ZPY : ZP;
+        if(op.mode != IND && inst->has(zeroMode) && (!constant || op.info.isShort))
         {
-            //IDY
-            string tmp = curString.substr(1, 3); //this is assuming $ will always have two digits
-            if(!opCodes[IDY])
+            out[0] = opCodes[zeroMode];
+            out[1] = (byte)value;
+            if(!constant)
             {
-                errorStack.push("Illegal address mode IDY for " + opStr);
-                return -1;
+                ref.kind = REF_ZP;
+                if(inst->has(op.mode))
+                {
+                    ref.relax = RELAX_ZP;
+                    ref.longOpcode = opCodes[op.mode];
+                }
             }
-            byte value = (byte)extractValue(tmp) & 0xFF;
-            currentCode.push_back(opCodes[IDY]);
-            currentCode.push_back(value);
             return 2;
         }
-        curString = curString.substr(0, curString.find(','));
-        if(curString.length() > 2)
+        if(inst->has(op.mode))
         {
-            //ABY
-            if(!opCodes[ABY])
-            {
-                errorStack.push("Illegal address mode ABY for " + opStr);
-                return -1;
-            }
-            short value = extractValue(curString);
-            byte high = (value >> 8) & 0xFF;
-            byte low = (value) & 0xFF;
-            currentCode.push_back(opCodes[ABY]);
-            currentCode.push_back(low);
-            currentCode.push_back(high);
+            out[0] = opCodes[op.mode];
+            out[1] = (byte)(value & 0xFF);
+            out[2] = (byte)((value >> 8) & 0xFF);
+            if(!constant)
+                ref.kind = REF_ABS;
             return 3;
         }
-        else
-        {
-            //ZPX
-            if(!opCodes[ZPY])
-            {
-                errorStack.push("Illegal address mode ZPX for " + opStr);
-                return -1;
-            }
-            byte value = (byte)extractValue(curString) & 0xFF;
-            currentCode.push_back(opCodes[ZPY]);
-            currentCode.push_back(value);
-            return 2;
-        }
+        if(op.mode != IND && constant && value <= 0xFF && inst->has(zeroMode))
+            op.mode = zeroMode;
     }
-    //No X, nor Y. could be ZP IND ABS REL
-    if(contains(curString, '(') && contains(curString, ')'))
-    {
-        //need them both! IND
-        if(!opCodes[IND])
-        {
-            errorStack.push("Illegal address mdoe IND for " + opStr);
-            return -1;
-        }
-        string tmp = curString.substr(1, curString.find(')') - 1);
-        short value = -1;
-        if(!(isdigit(tmp[0])) && !(tmp[0] == '$'))
-        {
-            //we have a label
-            value = getLabel(tmp);
-            if(value == -1)
-            {
-                //we don't have an address for that label yet!
-                //unresolvedLabelMap[tmp] = currentPC; //store it's result for later resolution
-                tmp = StringToUpper(tmp);
-                unresolvedLabelStack.push(new UnLabelEntry(tmp, currentPC));
-            }
-        }
-        else
-        {
-            value = extractValue(tmp);
-        }
-        byte high = (value >> 8) & 0xFF;
-        byte low  = (value & 0xFF);
-        currentCode.push_back(opCodes[IND]);
-        currentCode.push_back(low);
-        currentCode.push_back(high);
-        return 3;
-    }
-    //Not IND
-    if(curString.length() > 3 && curString[0] == '$')
-    {
-        //string is $xxxx
-        //ABS
-        if(!opCodes[ABS])
-        {
-            errorStack.push("Illegal address mode ABS for " + opStr);
-            return -1;
-        }
 
-        short value = extractValue(curString);
-        byte high = (value >> 8) & 0xFF;
-        byte low = (value & 0xFF);
-        currentCode.push_back(opCodes[ABS]);
-        currentCode.push_back(low);
-        currentCode.push_back(high);
-        return 3;
-    }
-    if((curString.length() == 3 || curString.length() == 2 )&& curString[0] == '$')
-    {
-        //string is $xx or $x
-        //ZP
-        if(!opCodes[ZP])
-        {
-            errorStack.push("Illegal address mode ZP for " + opStr);
-            return -1;
-        }
+    error = string("Illegal address mode ") + getModeName(op.mode) + " for " + upperKey(line.mnemonic);
+    return -1;
+}
 
-        byte value = (byte)extractValue(curString) & 0xFF;
-        currentCode.push_back(opCodes[ZP]);
-        currentCode.push_back(value);
-        return 2;
-    }
-    //Could only be a label, assuming relative or absolute!
-    if(!opCodes[REL] && !opCodes[ABS])
+//return bytes generated
+int Assembler::decodeLine(const SourceLine& line)
+{
+    if(!line.label.empty())
+        createLabel(line.label);
+    if(equalsNoCase(line.mnemonic, ".EXPORT"))
+        return addExports(line);
+
+    byte code[3];
+    string error;
+    int size = encodeLine(line, code, lineRef, error, binder);
+    if(size == -1)
     {
-        errorStack.push("Illegal address mode REL for " + opStr);
+        errorStack.push(lineError(line.number, error));
         return -1;
     }
-    short tmpAddr = getLabel(curString);
 
-    if(opStr[0] == 'B' || opStr[0] == 'b')
-    {
-        //relative + branch
+    //label addresses can still move, so operands that depend on them or
+    //the PC are all worked out in resolveLabels()
+    if(lineRef.kind != REF_NONE)
+        addFixup(line.number);
 
-        if(tmpAddr == -1)
-        {
-            //label doesn't exist yet, need to resolve as branch later, so target will be at a later address.
-            string tmp = StringToUpper(curString);
-            //unresolvedBranchMap[tmp] = currentPC;
-            unresolvedBranchStack.push(new UnLabelEntry(tmp, currentPC));
-        }
+    currentCode.insert(currentCode.end(), code, code + size);
+    return size;
+}
 
-        sbyte value = calculateBranch(currentPC, tmpAddr);
-        currentCode.push_back(opCodes[REL]);
-        currentCode.push_back(value);
-        return 2;
-    }
-    else
+//.export name, name... Only assembleModule() uses the list, a plain
+//assemble() has no one to export to.
+int Assembler::addExports(const SourceLine& line)
+{
+    string_view names = line.operand;
+    while(true)
     {
-        //absolute, probably a jump
-        if(tmpAddr == -1)
+        size_t comma = names.find(',');
+        string_view name = trim(names.substr(0, comma));
+        if(name.empty())
         {
-            //label doesn't exist, put into unresolved labels for later.
-            string tmp = StringToUpper(curString);
-            //unresolvedLabelMap[tmp] = currentPC;
-            unresolvedLabelStack.push(new UnLabelEntry(tmp, currentPC));
+            errorStack.push(lineError(line.number, ".export needs a list of labels"));
+            return -1;
         }
-
-        byte high = (tmpAddr >> 8) & 0xFF;
-        byte low = (tmpAddr & 0xFF);
-        currentCode.push_back(opCodes[ABS]);
-        currentCode.push_back(low);
-        currentCode.push_back(high);
-        return 3;
+        exportNames.push_back(ExportName{string(name), line.number});
+        if(comma == string_view::npos)
+            return 0;
+        names.remove_prefix(comma + 1);
     }
-
 }
 
-int Assembler::assemble()
+//shared by assemble() and assembleModule(), lays the code out from offset
+int Assembler::assembleText()
 {
     int tmpRes = 0;
     currentPC = 0 + offset;
     outputBlock = 0;
     currentCode.clear();
-    labelMap.clear();
-    //unresolvedLabelStack.clear();
-    //unresolvedBranchStack.clear();
-
+    //everything from the last run goes at once
+    labels.clear();
+    arena.reset();
+    fixups = 0;
+    relaxable.clear();
+    relaxableAt.clear();
+    placed.clear();
+    placedAt.clear();
+    listing.clear();
+    exportNames.clear();
 
     //main logic goes here
     if(inputBuffer == "")
@@ -590,32 +645,123 @@ int Assembler::assemble()
         return -1;
     }
 
-    vector<string> lines = SplitString(inputBuffer, "\n");
-    for(unsigned int i = 0; i < lines.size(); i++)
+    const string* source = &inputBuffer;
+    preprocessor.reset();
+    if(Preprocessor::needed(inputBuffer))
+    {
+        if(!preprocessor.process(inputBuffer, expandedBuffer))
+        {
+            moveErrors(preprocessor.getErrors(), &errorStack);
+            return -1;
+        }
+        source = &expandedBuffer;
+    }
+
+    Lexer lexer(*source);
+    SourceLine line;
+    while(lexer.next(line))
     {
-        tmpRes = decodeLine(lines[i]);
+        unsigned int position = currentCode.size();
+        tmpRes = decodeLine(line);
         if(tmpRes == -1)
             return -1; //Failed to assemble, check the errorStack for error list
         else
             currentPC += tmpRes; //tmp res is how many bytes were written
+        listing.push_back(ListedLine{line.text, line.number, position, (unsigned int)tmpRes});
     }
+    return currentCode.size();
+}
+
+int Assembler::assemble()
+{
+    relocatable = false;
+    if(assembleText() == -1)
+        return -1;
+    relaxOperands();
     //When that's done, hopefully without error, resolve branches.
-    tmpRes = resolveLabels();
-    if(tmpRes == -1)    //we failed!
+    if(resolveLabels() == -1)    //we failed!
         return -1;
     outputBlock = currentCode.data();
     return currentCode.size();
 
 }
 
+bool Assembler::assembleModule(ObjectModule& module)
+{
+    short savedOffset = offset;
+    relocatable = true;
+    offset = 0;
+
+    module.code.clear();
+    module.exports.clear();
+    module.imports.clear();
+    module.relocs.clear();
+    bool ok = assembleText() != -1;
+    if(ok)
+    {
+        relaxOperands(&module);
+        ok = resolveLabels(&module) != -1;
+    }
+    offset = savedOffset;
+    relocatable = false;
+    if(!ok)
+        return false;
+
+    //the other labels stay inside the module, relocated against its base
+    for(size_t i = 0; i < exportNames.size(); i++)
+    {
+        Symbol* symbol = labels.find(exportNames[i].name);
+        if(!symbol || !symbol->defined)
+        {
+            errorStack.push(lineError(exportNames[i].line, "Exported label " + exportNames[i].name + " isn't defined"));
+            return false;
+        }
+        module.exports[symbol->name] = symbol->value;
+    }
+    module.code = currentCode;
+    return true;
+}
+
 stack<string>* Assembler::getErrors()
 {
     return &errorStack;
 }
 
+void Assembler::setIncludeCache(IncludeCache* cache)
+{
+    preprocessor.setCache(cache);
+}
+
+void Assembler::addIncludePath(string path)
+{
+    preprocessor.addIncludePath(path);
+}
+
+//keeps the order, the top error stays on top
+void moveErrors(stack<string>* from, stack<string>* to)
+{
+    vector<string> errors;
+    for(; !from->empty(); from->pop())
+        errors.push_back(from->top());
+    for(size_t i = errors.size(); i > 0; i--)
+        to->push(errors[i - 1]);
+}
+
+map<string, short> Assembler::getLabels()
+{
+    map<string, short> result;
+    labels.forEach([&result](const Symbol& symbol)
+    {
+        if(symbol.defined)
+            result[symbol.name] = symbol.value;
+    });
+    return result;
+}
+
 void Assembler::setText(string text)
 {
     inputBuffer = text;   
+    listing.clear();    //its views point into the old text
 }
 
 byte* Assembler::getBinary()
@@ -628,230 +774,147 @@ void Assembler::setOffset(short offset)
     this->offset = offset;
 }
 
-void Assembler::outputToFile(string fileName)
-{
-    return;
-}
-
-void Assembler::loadTable()
-{
-    //Load table of instructions.
-
-    /* ADC */
-    setEntry(0x69, IMM, "ADC");
-    setEntry(0x65, ZP,  "ADC");
-    setEntry(0x75, ZPX, "ADC");
-    setEntry(0x6D, ABS, "ADC");
-    setEntry(0x7D, ABX, "ADC");
-    setEntry(0x79, ABY, "ADC");
-    setEntry(0x61, IDX, "ADC");
-    setEntry(0x71, IDY, "ADC");
-
-    /* AND */
-    setEntry(0x29, IMM, "AND");
-    setEntry(0x25, ZP,  "AND");
-    setEntry(0x35, ZPX, "AND");
-    setEntry(0x2D, ABS, "AND");
-    setEntry(0x3D, ABX, "AND");
-    setEntry(0x39, ABY, "AND");
-    setEntry(0x21, IDX, "AND");
-    setEntry(0x31, IDY, "AND");
-
-    /* ASL */
-    setEntry(0x0A, IMP, "ASL");
-    setEntry(0x06, ZP,  "ASL");
-    setEntry(0x16, ZPX, "ASL");
-    setEntry(0x0E, ABS, "ASL");
-    setEntry(0x1E, ABX, "ASL");
-
-    /* Bxx */
-    setEntry(0x90, REL, "BCC");
-    setEntry(0xB0, REL, "BCS");
-    setEntry(0xF0, REL, "BEQ");
-    setEntry(0x30, REL, "BMI");
-    setEntry(0xD0, REL, "BNE");
-    setEntry(0x10, REL, "BPL");
-    setEntry(0x50, REL, "BVC");
-    setEntry(0x70, REL, "BVS");
-
-    setEntry(0x24, ZP, "BIT");
-    setEntry(0x2C, ABS,"BIT");
-
-    setEntry(0x00, IMP, "BRK");
-
-    /* Cxx */
-    setEntry(0x18, IMP, "CLC");
-    setEntry(0xD8, IMP, "CLD");
-    setEntry(0x58, IMP, "CLI");
-    setEntry(0xB8, IMP, "CLV");
-
-    /* CMP */
-    setEntry(0xC9, IMM, "CMP");
-    setEntry(0xC5, ZP,  "CMP");
-    setEntry(0xD5, ZPX, "CMP");
-    setEntry(0xCD, ABS, "CMP");
-    setEntry(0xDD, ABX, "CMP");
-    setEntry(0xD9, ABY, "CMP");
-    setEntry(0xC1, IDX, "CMP");
-    setEntry(0xD1, IDY, "CMP");
-
-    /* CPX */
-    setEntry(0xE0, IMM, "CPX");
-    setEntry(0xE4, ZP,  "CPX");
-    setEntry(0xEC, ABS, "CPX");
-
-    /* CPY */
-    setEntry(0xC0, IMM, "CPY");
-    setEntry(0xC4, ZP,  "CPY");
-    setEntry(0xCC, ABS, "CPY");
-
-    /* DEC */
-    setEntry(0xC6, ZP,  "DEC");
-    setEntry(0xD6, ZPX, "DEC");
-    setEntry(0xCE, ABS, "DEC");
-    setEntry(0xDE, ABX, "DEC");
-
-    setEntry(0xCA, IMP, "DEX");
-    setEntry(0x88, IMP, "DEY");
-
-    /* EOR */
-    setEntry(0x49, IMM, "EOR");
-    setEntry(0x45, ZP,  "EOR");
-    setEntry(0x55, ZPX, "EOR");
-    setEntry(0x4D, ABS, "EOR");
-    setEntry(0x5D, ABX, "EOR");
-    setEntry(0x59, ABY, "EOR");
-    setEntry(0x41, IDX, "EOR");
-    setEntry(0x51, IDY, "EOR");
-
-    /* INC */
-    setEntry(0xE6, ZP,  "INC");
-    setEntry(0xF6, ZPX, "INC");
-    setEntry(0xEE, ABS, "INC");
-    setEntry(0xFE, ABX, "INC");
-
-    setEntry(0xE8, IMP, "INX");
-    setEntry(0xC8, IMP, "INY");
-
-    /* JMP */
-    setEntry(0x4C, ABS, "JMP");
-    setEntry(0x6C, IND, "JMP");
-    
-    setEntry(0x20, ABS, "JSR");
-    
-    /* LDA */
-    setEntry(0xA9, IMM, "LDA");
-    setEntry(0xA5, ZP,  "LDA");
-    setEntry(0xB5, ZPX, "LDA");
-    setEntry(0xAD, ABS, "LDA");
-    setEntry(0xBD, ABX, "LDA");
-    setEntry(0xB9, ABY, "LDA");
-    setEntry(0xA1, IDX, "LDA");
-    setEntry(0xB1, IDY, "LDA");
-    
-    /* LDX */
-    setEntry(0xA2, IMM, "LDX");
-    setEntry(0xA6, ZP,  "LDX");
-    setEntry(0xB6, ZPY, "LDX");
-    setEntry(0xAE, ABS, "LDX");
-    setEntry(0xBE, ABY, "LDX");
-    
-    /* LDY */
-    setEntry(0xA0, IMM, "LDY");
-    setEntry(0xA4, ZP,  "LDY");
-    setEntry(0xB4, ZPX, "LDY");
-    setEntry(0xAC, ABS, "LDY");
-    setEntry(0xBC, ABX, "LDY");
-    
-    /* LSR */
-    setEntry(0x4A, IMP, "LSR");
-    setEntry(0x46, ZP,  "LSR");
-    setEntry(0x56, ZPX, "LSR");
-    setEntry(0x4E, ABS, "LSR");
-    setEntry(0x5E, ABX, "LSR");
-    
-    /* NOP */
-    setEntry(0xEA, IMP, "NOP");
-    
-    /* ORA */
-    setEntry(0x09, IMM, "ORA");
-    setEntry(0x05, ZP,  "ORA");
-    setEntry(0x15, ZPX, "ORA");
-    setEntry(0x0D, ABS, "ORA");
-    setEntry(0x1D, ABX, "ORA");
-    setEntry(0x19, ABY, "ORA");
-    setEntry(0x01, IDX, "ORA");
-    setEntry(0x11, IDY, "ORA");
-    
-    /* pushing and pulling */
-    setEntry(0x48, IMP, "PHA");
-    setEntry(0x08, IMP, "PHP");
-    setEntry(0x68, IMP, "PLA");
-    setEntry(0x28, IMP, "PLP");
-    
-    /* ROL */
-    setEntry(0x2A, IMP, "ROL");
-    setEntry(0x26, ZP,  "ROL");
-    setEntry(0x36, ZPX, "ROL");
-    setEntry(0x2E, ABS, "ROL");
-    setEntry(0x3E, ABX, "ROL");
-    
-    /* ROR */
-    setEntry(0x6A, IMP, "ROR");
-    setEntry(0x66, ZP,  "ROR");
-    setEntry(0x76, ZPX, "ROR");
-    setEntry(0x6E, ABS, "ROR");
-    setEntry(0x7E, ABX, "ROR");
-    
-    setEntry(0x40, IMP, "RTI");
-    
-    setEntry(0x60, IMP, "RTS");
-    
-    /* SBC */
-    setEntry(0xE9, IMM, "SBC");
-    setEntry(0xE5, ZP,  "SBC");
-    setEntry(0xF5, ZPX, "SBC");
-    setEntry(0xED, ABS, "SBC");
-    setEntry(0xFD, ABX, "SBC");
-    setEntry(0xF9, ABY, "SBC");
-    setEntry(0xE1, IDX, "SBC");
-    setEntry(0xF1, IDY, "SBC");  
-    
-    setEntry(0x38, IMP, "SEC");
-    setEntry(0xF8, IMP, "SED");
-    setEntry(0x78, IMP, "SEI");
-    
-    /* STA */
-    setEntry(0x85, ZP,  "STA");
-    setEntry(0x95, ZPX, "STA");
-    setEntry(0x8D, ABS, "STA");
-    setEntry(0x9D, ABX, "STA");
-    setEntry(0x99, ABY, "STA");
-    setEntry(0x81, IDX, "STA");
-    setEntry(0x91, IDY, "STA");
-    
-    /* STX */
-    setEntry(0x86, ZP,  "STX");
-    setEntry(0x96, ZPY, "STX");
-    setEntry(0x8E, ABS, "STX");
-    
-    /* STY */
-    setEntry(0x84, ZP,  "STY");
-    setEntry(0x94, ZPX, "STY");
-    setEntry(0x8C, ABS, "STY");
-    
-    /* Txx */
-    setEntry(0xAA, IMP, "TAX");
-    setEntry(0xA8, IMP, "TAY");
-    setEntry(0xBA, IMP, "TSX");
-    setEntry(0x8A, IMP, "TXA");
-    setEntry(0x9A, IMP, "TXS");
-    setEntry(0x98, IMP, "TYA");
-    
-    //Table should be all set.      
-}
-
-UnLabelEntry::UnLabelEntry(string name, short tAddr) : labelName(name), targetAddress(tAddr)
+static void putWord16(ofstream& out, unsigned short value)
+{
+    char bytes[2];
+    bytes[0] = value & 0xFF;
+    bytes[1] = (value >> 8) & 0xFF;
+    out.write(bytes, 2);
+}
+
+static void putWord32(ofstream& out, unsigned int value)
+{
+    putWord16(out, value & 0xFFFF);
+    putWord16(out, value >> 16);
+}
+
+bool Assembler::openOutput(ofstream& out, string fileName, bool binary)
+{
+    out.open(fileName.c_str(), binary ? ios::out | ios::binary | ios::trunc : ios::out | ios::trunc);
+    if(!out)
+        errorStack.push("Couldn't write " + fileName);
+    return (bool)out;
+}
+
+//flushes, and says so if anything went wrong since openOutput()
+bool Assembler::closeOutput(ofstream& out, string fileName)
+{
+    out.close();
+    if(!out)
+        errorStack.push("Couldn't write " + fileName);
+    return (bool)out;
+}
+
+//address, code and source of every line, macros and includes expanded
+bool Assembler::writeListing(string fileName)
+{
+    ofstream out;
+    if(!openOutput(out, fileName, false))
+        return false;
+    out << hex << uppercase << setfill('0');
+    for(size_t i = 0; i < listing.size(); i++)
+    {
+        const ListedLine& line = listing[i];
+        out << setw(4) << (unsigned short)(offset + line.position) << " ";
+        for(unsigned int b = 0; b < 5; b++)
+        {
+            if(b < line.size)
+                out << " " << setw(2) << (int)currentCode[line.position + b];
+            else
+                out << "   ";
+        }
+        out << "  " << line.text << "\n";
+    }
+    return closeOutput(out, fileName);
+}
+
+//"$ADDR LABEL", lowest address first
+bool Assembler::writeSymbols(string fileName)
+{
+    ofstream out;
+    if(!openOutput(out, fileName, false))
+        return false;
+    vector<pair<unsigned short, string> > symbols;
+    labels.forEach([&symbols](const Symbol& symbol)
+    {
+        if(symbol.defined)
+            symbols.push_back(make_pair((unsigned short)symbol.value, string(symbol.name)));
+    });
+    sort(symbols.begin(), symbols.end());
+    out << hex << uppercase << setfill('0');
+    for(size_t i = 0; i < symbols.size(); i++)
+        out << "$" << setw(4) << symbols[i].first << " " << symbols[i].second << "\n";
+    return closeOutput(out, fileName);
+}
+
+static bool byAddress(const LineMapEntry& a, const LineMapEntry& b)
 {
+    return a.address < b.address;
+}
+
+//see trace/linemap.h, lines that didn't produce code are left out
+bool Assembler::writeLineMap(string fileName)
+{
+    vector<LineMapEntry> entries;
+    vector<string> files(1);
+    map<string, unsigned short> fileIndex;
+    fileIndex[""] = 0;
+    string file;
+    for(size_t i = 0; i < listing.size(); i++)
+    {
+        const ListedLine& line = listing[i];
+        if(!line.size)
+            continue;
+        LineMapEntry entry;
+        entry.line = preprocessor.origin(line.number, file);
+        entry.address = offset + line.position;
+        entry.size = line.size;
+        map<string, unsigned short>::iterator it = fileIndex.find(file);
+        if(it == fileIndex.end())
+        {
+            it = fileIndex.insert(make_pair(file, (unsigned short)files.size())).first;
+            files.push_back(file);
+        }
+        entry.file = it->second;
+        entry.pad = 0;
+        entries.push_back(entry);
+    }
+    //code that runs past $FFFF wraps around to the bottom
+    stable_sort(entries.begin(), entries.end(), byAddress);
 
+    ofstream out;
+    if(!openOutput(out, fileName, true))
+        return false;
+    out.write("HEVL", 4);
+    putWord32(out, LINEMAP_VERSION);
+    putWord32(out, entries.size());
+    putWord32(out, files.size());
+    putWord32(out, LINEMAP_HEADER + entries.size() * sizeof(LineMapEntry));
+    for(size_t i = 0; i < entries.size(); i++)
+    {
+        putWord32(out, entries[i].line);
+        putWord16(out, entries[i].address);
+        putWord16(out, entries[i].size);
+        putWord16(out, entries[i].file);
+        putWord16(out, entries[i].pad);
+    }
+    for(size_t i = 0; i < files.size(); i++)
+        out.write(files[i].c_str(), files[i].size() + 1);
+    return closeOutput(out, fileName);
+}
+
+//fileName without the extension. The .map lets the profiler and the trace
+//tools find the source line behind an address without the assembler.
+bool Assembler::outputToFile(string fileName)
+{
+    if(!outputBlock || listing.empty())
+    {
+        errorStack.push("Nothing assembled to write out");
+        return false;
+    }
+    ofstream out;
+    if(!openOutput(out, fileName + ".bin", true))
+        return false;
+    out.write((const char*)currentCode.data(), currentCode.size());
+    return closeOutput(out, fileName + ".bin") && writeListing(fileName + ".lst") && writeSymbols(fileName + ".sym") && writeLineMap(fileName + ".map");
 }
@@ -6,23 +6,19 @@
 #include <stack>
 #include <algorithm>
 #include <string>
+#include <string_view>
 #include <string.h>
 #include <sstream>
+#include <fstream>
 #include <stdlib.h>
 #include <ctype.h>
-
-#define IMM 0
-#define ZP  1
-#define ZPX 2
-#define ZPY 3
-#define ABS 4
-#define ABX 5
-#define ABY 6
-#define IND 7
-#define IDX 8
-#define IDY 9
-#define IMP 10
-#define REL 11
+#include "lexer.h"
+#include "preprocessor.h"
+#include "mnemonics.h"
+#include "arena.h"
+#include "symboltable.h"
+#include "objectmodule.h"
+#include "expression.h"
 
 #define byte unsigned char
 #define sbyte char
@@ -30,12 +26,59 @@
 using namespace std;
 //6502 assembler
 
-class UnLabelEntry
+//An operand expression waiting for its labels, chained in the arena.
+class Fixup
+{
+public:
+    const byte*    code;        //compiled expression, see expression.h
+    unsigned short length;
+    unsigned short address;     //address of the instruction, what * means
+    byte           kind;        //REF_*
+    byte           relax;       //RELAX_*
+    byte           longOpcode;  //for RELAX_ZP
+    byte           operand;     //offset of the operand bytes in the instruction
+    int            line;        //for error messages
+    Fixup*         next;
+};
+
+#define REF_NONE   0
+#define REF_ABS    1    //16 bit address
+#define REF_BRANCH 2    //branch offset to the target address
+#define REF_BYTE   3    //immediate, the low byte of the value
+#define REF_ZP     4    //zero page address, has to fit in a byte
+
+//Operands that depend on labels are encoded short first and only grow
+//once the labels are known and the value doesn't fit.
+#define RELAX_NONE   0
+#define RELAX_ZP     1    //zero page, absolute when the value is over $FF
+#define RELAX_BRANCH 2    //branch, the opposite branch over a JMP when it's too far
+
+//What an encoded line still needs from the labels or the PC.
+class LineRef
+{
+public:
+    byte         kind;
+    vector<byte> expr;      //compiled operand, labels bound by the caller
+    byte         relax;
+    byte         longOpcode;    //absolute form of a RELAX_ZP instruction
+};
+
+//Where a source line ended up, for the listing and the line map.
+class ListedLine
+{
+public:
+    string_view  text;      //into the text the Lexer saw
+    int          number;    //line in that text
+    unsigned int position;  //in currentCode
+    unsigned int size;
+};
+
+//A label named by .export, checked once the module is assembled.
+class ExportName
 {
 public:
-    UnLabelEntry(string, short);
-    string labelName;
-    short  targetAddress;
+    string name;
+    int    line;
 };
 
 class Assembler
@@ -44,33 +87,65 @@ public:
     Assembler();            //offset address for labels
    // ~Assembler();
     int       assemble();                    //do the magic.
+    bool      assembleModule(ObjectModule& module); //relocatable, for the Linker. Ignores the offset.
     void      setText(string toSet);         //set our input buffer
     byte*     getBinary();                   //return code block
     void      setOffset(short offset);       //setting the offset for labels.
-    void      outputToFile(string fileName); //Output the binary as hex
+    bool      outputToFile(string fileName); //Write fileName.bin, .lst, .sym and .map for the last assemble
     stack<string>* getErrors();                   //Get list of errors
+    map<string, short> getLabels();               //Get labels from the last assemble
+    void      setIncludeCache(IncludeCache* cache); //Share prepared include files with other Assemblers
+    void      addIncludePath(string path);        //Searched by .include after the including file's directory
+    static int encodeLine(const SourceLine& line, byte* out, LineRef& ref, string& error, const LabelBinder& bind);
+    static bool patchOperand(byte* operand, byte kind, int value, unsigned short address, string& error);
+    static bool fitsShort(byte relax, int value, unsigned short address);
+    static int  widen(const byte* code, byte relax, byte longOpcode, byte* out); //long form, returns its size
+    static int  growth(byte relax);           //bytes widen() adds
 private:
-    int       decodeLine(string line);      //Assembles a single line, buffer poitns to current input buffer.
-    void      loadTable();                   //Assign cmds to instruction table.
-    void      setEntry(byte opCode, byte, string);
-    short     getLabel(string);
-    bool      createLabel(string label);
-    bool      isInstruction(string& toCheck);
-    int       resolveLabels();                //Resolve and fix all remaining labels.
-    sbyte     calculateBranch(short addr, short branchAddr);
+    int       decodeLine(const SourceLine& line); //Assembles a single line, views point into the input buffer.
+    bool      createLabel(string_view label);
+    int       addExports(const SourceLine& line);
+    void      addFixup(int line);
+    bool      isInstruction(string_view toCheck);
+    int       assembleText();                 //Lay out every line, leaving the fixups.
+    void      relaxOperands(ObjectModule* module = 0); //Grow the short operands that don't fit
+    bool      fits(const Fixup* fixup, unsigned short address, ObjectModule* module);
+    void      placeLabels(const vector<unsigned int>& shift);
+    void      widenOperands(const vector<unsigned int>& shift, const vector<bool>& wide);
+    unsigned int shiftAt(const vector<unsigned int>& shift, unsigned int position);
+    int       resolveLabels(ObjectModule* module = 0); //Resolve and fix all remaining labels.
+    bool      relocate(ObjectModule* module, const Fixup* fixup, byte* operand, string& error);
+    string    lineError(int line, string message);
+    bool      openOutput(ofstream& out, string fileName, bool binary);
+    bool      closeOutput(ofstream& out, string fileName);
+    bool      writeListing(string fileName);
+    bool      writeSymbols(string fileName);
+    bool      writeLineMap(string fileName);
 
     short     currentPC;                    //current program counter.
     short     offset;                       //offset should we need it.
     string    inputBuffer;                  //Assembly code
+    string    expandedBuffer;               //inputBuffer after the preprocessor, if it had anything to do
+    Preprocessor preprocessor;
     byte*     outputBlock;                  //Binary output;
-    byte      byteCounts[12];               //byte count per address mode.
-    map<string, byte*> opTable;             //Opcode table
-    map<string, short> labelMap;            //Map maintaining labels.
-    stack<UnLabelEntry*> unresolvedLabelStack;     //Labels we don't know yet.
-    stack<UnLabelEntry*> unresolvedBranchStack;    //labels for unlabeled branches
+    byte      byteCounts[ADDR_MODES];               //byte count per address mode.
+    Arena     arena;                        //fixups and label names, reset every assemble
+    SymbolTable labels;                     //Table maintaining labels.
+    Fixup*    fixups;                       //operands waiting for labels we don't know yet.
+    vector<Fixup*> relaxable;               //fixups that can still grow, in address order
+    vector<unsigned int> relaxableAt;       //their position in currentCode before anything grew
+    vector<Symbol*> placed;                 //labels in the order they were defined
+    vector<unsigned int> placedAt;          //their position in currentCode before anything grew
+    vector<ListedLine> listing;             //every line assembled, in order
+    vector<ExportName> exportNames;         //from .export, the only labels a module exports
+    LineRef   lineRef;                      //reused by decodeLine()
+    LabelBinder binder;                     //labels in expressions are Symbol*
+    bool      relocatable;                  //assembling a module, keep every label fixup
     vector<byte> currentCode;               //Vector of current code
     stack<string> errorStack;               //stack of errors we've encountered.
 
 };
 
+void moveErrors(stack<string>* from, stack<string>* to);
+
 #endif // ASSEMBLER_H
@@ -0,0 +1,303 @@
+#include <algorithm>
+#include "expression.h"
+#include "lexer.h"
+
+#define MAX_NESTING 64  //brackets and unary operators inside each other
+
+//Recursive descent over one operand, lowest precedence first:
+//  |  ^  &  << >>  + -  * /  then unary - ~ < >
+//except that < or > in front of everything applies to all of it.
+class ExprParser
+{
+public:
+    ExprParser(string_view text, vector<byte>& code, const LabelBinder& bind, ExprInfo& info, string& error)
+        : literalShort(false), text(text), pos(0), code(code), bind(bind), info(info), error(error), depth(0), maxDepth(0), nesting(0) {}
+
+    bool parse();
+    bool literalShort;          //the last number was written as a zero page value
+private:
+    bool parseBinary(int level);
+    bool parseUnary();
+    bool parsePrimary();
+    byte binaryOp(int level, size_t& length);
+    void skipSpace();
+    void push(byte op);
+    bool fail(string message);
+
+    string_view text;
+    size_t pos;
+    vector<byte>& code;
+    const LabelBinder& bind;
+    ExprInfo& info;
+    string& error;
+    int depth;                  //values on the evaluator's stack at this point
+    int maxDepth;
+    int nesting;
+};
+
+#define LEVELS 6
+
+static bool isLabelStart(char c)
+{
+    return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || c == '_';
+}
+
+static bool isWordChar(char c)
+{
+    return isLabelStart(c) || (c >= '0' && c <= '9');
+}
+
+//$hex, %binary or decimal, the whole view has to be the number
+static bool parseNumber(string_view text, int& value, bool& isShort)
+{
+    int base = 10;
+    size_t i = 0;
+    if(text.empty())
+        return false;
+    if(text[0] == '$')
+    {
+        base = 16;
+        i = 1;
+    }
+    else if(text[0] == '%')
+    {
+        base = 2;
+        i = 1;
+    }
+    if(i >= text.size())
+        return false;
+
+    int digits = 0;
+    value = 0;
+    for(; i < text.size(); i++)
+    {
+        char c = toUpper(text[i]);
+        int digit;
+        if(c >= '0' && c <= '9')
+            digit = c - '0';
+        else if(c >= 'A' && c <= 'F')
+            digit = c - 'A' + 10;
+        else
+            return false;
+        if(digit >= base)
+            return false;
+        value = value * base + digit;
+        if(value > 0xFFFF)
+            return false;
+        digits++;
+    }
+    //$0012 is written as an absolute address even though it would fit
+    isShort = value <= 0xFF && !(base == 16 && digits > 2) && !(base == 2 && digits > 8);
+    return true;
+}
+
+void ExprParser::skipSpace()
+{
+    while(pos < text.size() && isSpace(text[pos]))
+        pos++;
+}
+
+void ExprParser::push(byte op)
+{
+    code.push_back(op);
+    if(op == EXPR_NUMBER || op == EXPR_LABEL || op == EXPR_PC)
+        maxDepth = max(maxDepth, ++depth);
+    else if(op >= EXPR_MUL)
+        depth--;
+}
+
+bool ExprParser::fail(string message)
+{
+    error = message + " in " + string(text);
+    return false;
+}
+
+bool ExprParser::parse()
+{
+    skipSpace();
+    if(pos >= text.size())
+        return fail("Missing value");
+    //most operands are a single number or label, they don't need the
+    //precedence levels
+    size_t end = pos + 1;
+    while(end < text.size() && isWordChar(text[end]))
+        end++;
+    if(end == text.size() && (isWordChar(text[pos]) || text[pos] == '$' || text[pos] == '%'))
+        return parsePrimary();
+
+    //#<table+1 is the low byte of table+1, the way 6502 code expects
+    byte part = 0;
+    if(text[pos] == '<' || text[pos] == '>')
+    {
+        part = (text[pos] == '<') ? EXPR_LOW : EXPR_HIGH;
+        pos++;
+    }
+    if(!parseBinary(0))
+        return false;
+    if(part)
+        push(part);
+    if(pos < text.size())
+        return fail("Unexpected " + string(1, text[pos]));
+    if(maxDepth > EXPR_STACK)
+        return fail("Expression too complex");
+    return true;
+}
+
+//the operator at pos if it belongs to this level, 0 if not
+byte ExprParser::binaryOp(int level, size_t& length)
+{
+    if(pos >= text.size())
+        return 0;
+    char c = text[pos];
+    char n = pos + 1 < text.size() ? text[pos + 1] : 0;
+    length = 1;
+    switch(level)
+    {
+    case 0: return c == '|' ? EXPR_OR : 0;
+    case 1: return c == '^' ? EXPR_XOR : 0;
+    case 2: return c == '&' ? EXPR_AND : 0;
+    case 3:
+        length = 2;
+        if(c == '<' && n == '<')
+            return EXPR_SHL;
+        if(c == '>' && n == '>')
+            return EXPR_SHR;
+        return 0;
+    case 4: return c == '+' ? EXPR_ADD : c == '-' ? EXPR_SUB : 0;
+    default: return c == '*' ? EXPR_MUL : c == '/' ? EXPR_DIV : 0;
+    }
+}
+
+bool ExprParser::parseBinary(int level)
+{
+    if(level == LEVELS)
+        return parseUnary();
+    if(!parseBinary(level + 1))
+        return false;
+    for(;;)
+    {
+        skipSpace();
+        size_t length;
+        byte op = binaryOp(level, length);
+        if(!op)
+            return true;
+        pos += length;
+        skipSpace();
+        if(!parseBinary(level + 1))
+            return false;
+        push(op);
+    }
+}
+
+bool ExprParser::parseUnary()
+{
+    skipSpace();
+    if(pos >= text.size())
+        return fail("Missing value");
+    byte op = 0;
+    switch(text[pos])
+    {
+    case '-': op = EXPR_NEG; break;
+    case '~': op = EXPR_NOT; break;
+    case '<': op = EXPR_LOW; break;
+    case '>': op = EXPR_HIGH; break;
+    default: return parsePrimary();
+    }
+    if(++nesting > MAX_NESTING)
+        return fail("Expression nested too deep");
+    pos++;
+    if(!parseUnary())
+        return false;
+    nesting--;
+    push(op);
+    return true;
+}
+
+bool ExprParser::parsePrimary()
+{
+    char c = text[pos];
+    if(c == '(' || c == '[')
+    {
+        char close = (c == '(') ? ')' : ']';
+        if(++nesting > MAX_NESTING)
+            return fail("Expression nested too deep");
+        pos++;
+        if(!parseBinary(0))
+            return false;
+        skipSpace();
+        if(pos >= text.size() || text[pos] != close)
+            return fail(string("Missing '") + close + "'");
+        pos++;
+        nesting--;
+        return true;
+    }
+    if(c == '*')
+    {
+        pos++;
+        info.pc = true;
+        push(EXPR_PC);
+        return true;
+    }
+
+    size_t start = pos;
+    if(c == '$' || c == '%')
+        pos++;
+    while(pos < text.size() && isWordChar(text[pos]))
+        pos++;
+    string_view word = text.substr(start, pos - start);
+    if(word.empty())
+        return fail("Unexpected " + string(1, c));
+
+    if(!isLabelStart(word[0]))
+    {
+        int value;
+        if(!parseNumber(word, value, literalShort))
+        {
+            error = "Bad number " + string(word);
+            return false;
+        }
+        push(EXPR_NUMBER);
+        code.insert(code.end(), (byte*)&value, (byte*)&value + sizeof(value));
+        return true;
+    }
+
+    LabelHandle handle = bind(word);
+    info.labels = true;
+    push(EXPR_LABEL);
+    code.insert(code.end(), (byte*)&handle, (byte*)&handle + sizeof(handle));
+    return true;
+}
+
+//Appends to code. Constant expressions are folded down to one number,
+//with the value in info.
+bool compileExpression(string_view text, vector<byte>& code, const LabelBinder& bind, ExprInfo& info, string& error)
+{
+    info.labels = false;
+    info.pc = false;
+    info.isShort = false;
+    info.value = 0;
+
+    size_t start = code.size();
+    ExprParser parser(text, code, bind, info, error);
+    if(!parser.parse())
+        return false;
+    if(info.labels || info.pc)
+        return true;
+
+    LabelHandle missing;
+    if(evaluateExpression(code.data() + start, code.size() - start, 0, [](LabelHandle, int&) { return false; }, info.value, missing) != EVAL_OK)
+    {
+        error = "Division by zero in " + string(text);
+        return false;
+    }
+    //a lone number keeps the way it was written
+    if(code.size() - start == 1 + sizeof(int))
+        info.isShort = parser.literalShort;
+    else
+        info.isShort = info.value >= 0 && info.value <= 0xFF;
+
+    code.resize(start);
+    code.push_back(EXPR_NUMBER);
+    code.insert(code.end(), (byte*)&info.value, (byte*)&info.value + sizeof(info.value));
+    return true;
+}
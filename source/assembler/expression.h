@@ -0,0 +1,256 @@
+#ifndef EXPRESSION_H
+#define EXPRESSION_H
+
+#include <vector>
+#include <string>
+#include <string_view>
+#include <stdint.h>
+#include <limits.h>
+#include <string.h>
+
+#define byte unsigned char
+
+using namespace std;
+
+//Operands are compiled to RPN bytecode once, so an expression that has to
+//wait for a label is kept as a few bytes and evaluated later without going
+//back to the text.
+#define EXPR_NUMBER 0   //followed by an int
+#define EXPR_LABEL  1   //followed by a LabelHandle
+#define EXPR_PC     2   //address of the instruction the operand belongs to
+#define EXPR_NEG    3
+#define EXPR_NOT    4
+#define EXPR_LOW    5   //<x
+#define EXPR_HIGH   6   //>x
+#define EXPR_MUL    7
+#define EXPR_DIV    8
+#define EXPR_ADD    9
+#define EXPR_SUB    10
+#define EXPR_SHL    11
+#define EXPR_SHR    12
+#define EXPR_AND    13
+#define EXPR_XOR    14
+#define EXPR_OR     15
+
+#define EXPR_STACK  32  //deepest the evaluator goes, the compiler checks it
+
+#define EVAL_OK         0
+#define EVAL_UNDEFINED  1   //a label isn't defined (yet)
+#define EVAL_DIVZERO    2
+#define EVAL_RELOCATE   3   //can't be expressed as a relocation
+
+//Whoever compiles an expression decides what a label turns into, a Symbol*
+//for the Assembler or a label id for the IncrementalAssembler.
+typedef uintptr_t LabelHandle;
+
+class LabelBinder
+{
+public:
+    LabelHandle (*bind)(void* context, string_view name);
+    void*       context;
+
+    LabelHandle operator()(string_view name) const { return bind(context, name); }
+};
+
+class ExprInfo
+{
+public:
+    bool labels;    //refers to at least one label
+    bool pc;        //uses *
+    bool isShort;   //a lone number written as a zero page value, or a constant 0-$FF
+    int  value;     //when it's constant
+};
+
+bool compileExpression(string_view text, vector<byte>& code, const LabelBinder& bind, ExprInfo& info, string& error);
+
+//Calls func with the handle of every label an expression refers to.
+template<class F>
+void forEachLabel(const byte* code, size_t length, F func)
+{
+    for(size_t i = 0; i < length; )
+    {
+        byte op = code[i++];
+        if(op == EXPR_NUMBER)
+            i += sizeof(int);
+        else if(op == EXPR_LABEL)
+        {
+            LabelHandle handle;
+            memcpy(&handle, code + i, sizeof(handle));
+            func(handle);
+            i += sizeof(handle);
+        }
+    }
+}
+
+inline int applyUnary(byte op, int a)
+{
+    switch(op)
+    {
+    case EXPR_NEG:  return (int)(0u - (unsigned int)a);
+    case EXPR_NOT:  return ~a;
+    case EXPR_LOW:  return a & 0xFF;
+    default:        return (a >> 8) & 0xFF;
+    }
+}
+
+//false on division by zero, or INT_MIN / -1 which doesn't fit either.
+//The rest wraps at 32 bits instead of overflowing
+inline bool applyBinary(byte op, int a, int b, int& result)
+{
+    switch(op)
+    {
+    case EXPR_MUL:  result = (int)((unsigned int)a * (unsigned int)b); break;
+    case EXPR_DIV:
+        if(b == 0 || (b == -1 && a == INT_MIN))
+            return false;
+        result = a / b;
+        break;
+    case EXPR_ADD:  result = (int)((unsigned int)a + (unsigned int)b); break;
+    case EXPR_SUB:  result = (int)((unsigned int)a - (unsigned int)b); break;
+    case EXPR_SHL:  result = (b < 0 || b > 31) ? 0 : (int)((unsigned int)a << b); break;
+    case EXPR_SHR:  result = (b < 0 || b > 31) ? 0 : (int)((unsigned int)a >> b); break;
+    case EXPR_AND:  result = a & b; break;
+    case EXPR_XOR:  result = a ^ b; break;
+    default:        result = a | b; break;
+    }
+    return true;
+}
+
+//lookup(handle, value) returns false while the label isn't defined, the
+//first such handle is left in missing.
+template<class Lookup>
+byte evaluateExpression(const byte* code, size_t length, int pc, Lookup lookup, int& value, LabelHandle& missing)
+{
+    int stack[EXPR_STACK];
+    int top = 0;
+    stack[0] = 0;
+    for(size_t i = 0; i < length; )
+    {
+        byte op = code[i++];
+        switch(op)
+        {
+        case EXPR_NUMBER:
+            memcpy(&stack[top++], code + i, sizeof(int));
+            i += sizeof(int);
+            break;
+        case EXPR_LABEL:
+            memcpy(&missing, code + i, sizeof(missing));
+            i += sizeof(missing);
+            if(!lookup(missing, stack[top++]))
+                return EVAL_UNDEFINED;
+            break;
+        case EXPR_PC:
+            stack[top++] = pc;
+            break;
+        case EXPR_NEG:
+        case EXPR_NOT:
+        case EXPR_LOW:
+        case EXPR_HIGH:
+            stack[top - 1] = applyUnary(op, stack[top - 1]);
+            break;
+        default:
+            top--;
+            if(!applyBinary(op, stack[top - 1], stack[top], stack[top - 1]))
+                return EVAL_DIVZERO;
+            break;
+        }
+    }
+    value = stack[0];
+    return EVAL_OK;
+}
+
+//An expression in code that will be moved by the Linker: a constant plus
+//the module's load address (base 1) or an imported label, and optionally
+//just the low or high byte of that.
+class RelocValue
+{
+public:
+    int         value;
+    int         base;
+    LabelHandle import;     //0 for none
+    byte        part;       //0, EXPR_LOW or EXPR_HIGH
+};
+
+//Like evaluateExpression() with pc and defined labels relative to the
+//module, undefined labels become the import. Only sums and differences can
+//be moved, EVAL_RELOCATE for anything else that isn't constant.
+template<class Lookup>
+byte evaluateRelocatable(const byte* code, size_t length, int pc, Lookup lookup, RelocValue& result)
+{
+    RelocValue stack[EXPR_STACK];
+    int top = 0;
+    for(size_t i = 0; i < length; )
+    {
+        byte op = code[i++];
+        RelocValue& a = stack[top > 0 ? top - 1 : 0];
+        switch(op)
+        {
+        case EXPR_NUMBER:
+            stack[top] = RelocValue{0, 0, 0, 0};
+            memcpy(&stack[top++].value, code + i, sizeof(int));
+            i += sizeof(int);
+            break;
+        case EXPR_LABEL:
+        {
+            LabelHandle handle;
+            memcpy(&handle, code + i, sizeof(handle));
+            i += sizeof(handle);
+            int address;
+            if(lookup(handle, address))
+                stack[top++] = RelocValue{address, 1, 0, 0};
+            else
+                stack[top++] = RelocValue{0, 0, handle, 0};
+            break;
+        }
+        case EXPR_PC:
+            stack[top++] = RelocValue{pc, 1, 0, 0};
+            break;
+        case EXPR_LOW:
+        case EXPR_HIGH:
+            if(a.part)
+                return EVAL_RELOCATE;
+            if(a.base || a.import)
+                a.part = op;
+            else
+                a.value = applyUnary(op, a.value);
+            break;
+        case EXPR_NEG:
+        case EXPR_NOT:
+            if(a.base || a.import || a.part)
+                return EVAL_RELOCATE;
+            a.value = applyUnary(op, a.value);
+            break;
+        default:
+        {
+            top--;
+            RelocValue& left = stack[top - 1];
+            RelocValue& right = stack[top];
+            if(left.part || right.part)
+                return EVAL_RELOCATE;
+            if(op == EXPR_ADD && !(left.import && right.import))
+            {
+                left.value += right.value;
+                left.base += right.base;
+                left.import |= right.import;
+            }
+            else if(op == EXPR_SUB && !right.import)
+            {
+                //label - label inside one module is a constant
+                left.value -= right.value;
+                left.base -= right.base;
+            }
+            else if(left.base || left.import || right.base || right.import)
+                return EVAL_RELOCATE;
+            else if(!applyBinary(op, left.value, right.value, left.value))
+                return EVAL_DIVZERO;
+            break;
+        }
+        }
+    }
+    result = stack[0];
+    if(result.base < 0 || result.base > 1 || (result.base && result.import))
+        return EVAL_RELOCATE;
+    return EVAL_OK;
+}
+
+#endif // EXPRESSION_H
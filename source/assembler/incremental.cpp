@@ -0,0 +1,548 @@
+#include "incremental.h"
+
+#define CACHE_SLACK   4096  //stale lines kept before the cache is pruned
+#define COMPARE_BLOCK 4096
+
+//line is 0 based, in the text after the preprocessor
+string IncrementalAssembler::lineError(size_t line, string message)
+{
+    return preprocessor.location(line + 1) + ": " + message;
+}
+
+static string upperCopy(string_view text)
+{
+    string upper(text.size(), ' ');
+    for(size_t i = 0; i < text.size(); i++)
+        upper[i] = toUpper(text[i]);
+    return upper;
+}
+
+LabelHandle IncrementalAssembler::bindLabel(void* self, string_view name)
+{
+    return (LabelHandle)((IncrementalAssembler*)self)->labelId(name);
+}
+
+IncrementalAssembler::IncrementalAssembler()
+{
+    this->offset = 0;
+    this->valid = false;
+    this->linesEncoded = 0;
+    this->binder = LabelBinder{bindLabel, this};
+}
+
+void IncrementalAssembler::setText(string text)
+{
+    inputBuffer = text;
+}
+
+void IncrementalAssembler::setOffset(short offset)
+{
+    if(offset != this->offset)
+        valid = false;
+    this->offset = offset;
+}
+
+byte* IncrementalAssembler::getBinary()
+{
+    return image.data();
+}
+
+stack<string>* IncrementalAssembler::getErrors()
+{
+    return &errorStack;
+}
+
+void IncrementalAssembler::setIncludeCache(IncludeCache* cache)
+{
+    preprocessor.setCache(cache);
+}
+
+void IncrementalAssembler::addIncludePath(string path)
+{
+    preprocessor.addIncludePath(path);
+}
+
+int IncrementalAssembler::getLinesEncoded()
+{
+    return linesEncoded;
+}
+
+map<string, short> IncrementalAssembler::getLabels()
+{
+    map<string, short> result;
+    for(size_t id = 0; id < labelAddress.size(); id++)
+    {
+        if(labelAddress[id] != -1)
+            result[labelNames[id]] = labelAddress[id];
+    }
+    return result;
+}
+
+//labels are numbered once so layout doesn't have to hash names
+int IncrementalAssembler::labelId(string_view name)
+{
+    if(name.empty())
+        return -1;
+    string upper = upperCopy(name);
+    pair<unordered_map<string, int>::iterator, bool> slot = labelIds.try_emplace(upper, (int)labelNames.size());
+    if(slot.second)
+    {
+        labelNames.push_back(upper);
+        labelAddress.push_back(-1);
+        users.push_back(vector<size_t>());
+    }
+    return slot.first->second;
+}
+
+//FNV-1a, 64 bit
+unsigned long long IncrementalAssembler::hashLine(string_view text)
+{
+    unsigned long long hash = 14695981039346656037ull;
+    for(size_t i = 0; i < text.size(); i++)
+    {
+        hash ^= (unsigned char)text[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+IncrementalAssembler::CachedLine* IncrementalAssembler::encode(string_view text, unsigned long long hash)
+{
+    pair<unordered_map<unsigned long long, CachedLine>::iterator, bool> slot = cache.try_emplace(hash);
+    CachedLine* entry = &slot.first->second;
+    if(!slot.second)
+    {
+        if(entry->text == text)
+            return entry;
+        //another line with the same hash, it can't share the slot
+        collisions.push_back(CachedLine());
+        entry = &collisions.back();
+    }
+
+    Lexer lexer(text);
+    SourceLine line;
+    if(!lexer.next(line))
+        line.label = line.mnemonic = line.operand = string_view();
+
+    LineRef ref;
+    entry->text = string(text);
+    entry->size = Assembler::encodeLine(line, entry->code, ref, entry->error, binder);
+    entry->label = labelId(line.label);
+    entry->refKind = ref.kind;
+    entry->expr = ref.expr;
+    entry->relax = ref.relax;
+    entry->longOpcode = ref.longOpcode;
+    entry->refLabels.clear();
+    forEachLabel(ref.expr.data(), ref.expr.size(), [entry](LabelHandle id)
+    {
+        if(find(entry->refLabels.begin(), entry->refLabels.end(), (int)id) == entry->refLabels.end())
+            entry->refLabels.push_back((int)id);
+    });
+    linesEncoded++;
+    return entry;
+}
+
+void IncrementalAssembler::addUsers(const CachedLine* code, size_t line)
+{
+    for(size_t l = 0; l < code->refLabels.size(); l++)
+        users[code->refLabels[l]].push_back(line);
+}
+
+void IncrementalAssembler::removeUsers(const CachedLine* code, size_t line)
+{
+    for(size_t l = 0; l < code->refLabels.size(); l++)
+    {
+        vector<size_t>& list = users[code->refLabels[l]];
+        for(size_t i = 0; i < list.size(); i++)
+        {
+            if(list[i] == line)
+            {
+                list[i] = list.back();
+                list.pop_back();
+                break;
+            }
+        }
+    }
+}
+
+//errors are pushed last line first so the first one ends up on top
+bool IncrementalAssembler::reportErrors(size_t first, size_t last)
+{
+    bool ok = true;
+    for(size_t i = last; i > first; i--)
+    {
+        if(lines[i - 1].code->size == -1)
+        {
+            errorStack.push(lineError(i - 1, lines[i - 1].code->error));
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+byte IncrementalAssembler::evaluate(size_t line, int& value, LabelHandle& missing)
+{
+    const CachedLine* code = lines[line].code;
+    return evaluateExpression(code->expr.data(), code->expr.size(), lines[line].address, [this](LabelHandle id, int& result)
+    {
+        result = labelAddress[id];
+        return result != -1;
+    }, value, missing);
+}
+
+int IncrementalAssembler::lineSize(size_t line)
+{
+    const CachedLine* code = lines[line].code;
+    return code->size + (lines[line].wide ? Assembler::growth(code->relax) : 0);
+}
+
+//addresses for the current sizes, the first definition of a label wins
+void IncrementalAssembler::place(bool report)
+{
+    for(size_t id = 0; id < labelAddress.size(); id++)
+        labelAddress[id] = -1;
+    unsigned short address = offset;
+    for(size_t i = 0; i < lines.size(); i++)
+    {
+        const CachedLine* code = lines[i].code;
+        lines[i].address = address;
+        if(code->label != -1)
+        {
+            if(labelAddress[code->label] == -1)
+                labelAddress[code->label] = address;
+            else if(report)
+                errorStack.push("Label " + labelNames[code->label] + " already exists, not redefining");
+        }
+        address += lineSize(i);
+    }
+}
+
+//evaluate the operand a line left for the labels and its address
+bool IncrementalAssembler::resolve(size_t line)
+{
+    const CachedLine* code = lines[line].code;
+    if(code->refKind == REF_NONE)
+        return true;
+
+    unsigned short address = lines[line].address;
+    int value;
+    LabelHandle missing;
+    byte status = evaluate(line, value, missing);
+
+    string error;
+    if(status == EVAL_UNDEFINED)
+        error = "Couldn't resolve unkown label " + labelNames[missing];
+    else if(status == EVAL_DIVZERO)
+        error = "Division by zero";
+    //a widened branch has its target after the opposite branch and the JMP opcode
+    size_t at = (unsigned short)(address - offset);
+    size_t operand = (lines[line].wide && code->relax == RELAX_BRANCH) ? 3 : 1;
+    byte kind = lines[line].wide ? REF_ABS : code->refKind;
+    if(status != EVAL_OK || !Assembler::patchOperand(&image[at + operand], kind, value, address, error))
+    {
+        errorStack.push(lineError(line, error));
+        return false;
+    }
+    return true;
+}
+
+//everything from scratch, the lines are already encoded
+int IncrementalAssembler::layout()
+{
+    for(size_t id = 0; id < labelAddress.size(); id++)
+        users[id].clear();
+    image.clear();
+    if(!reportErrors(0, lines.size()))
+        return -1;
+
+    //short forms first, then grow whatever doesn't fit until nothing
+    //changes, the same passes Assembler::relaxOperands() makes
+    vector<size_t> relax;
+    for(size_t i = 0; i < lines.size(); i++)
+    {
+        lines[i].wide = false;
+        if(lines[i].code->relax != RELAX_NONE)
+            relax.push_back(i);
+    }
+    vector<size_t> grow;
+    for(bool first = true; ; first = false)
+    {
+        place(first);
+        grow.clear();
+        for(size_t r = 0; r < relax.size(); r++)
+        {
+            size_t i = relax[r];
+            int value;
+            LabelHandle missing;
+            if(!lines[i].wide && evaluate(i, value, missing) == EVAL_OK
+               && !Assembler::fitsShort(lines[i].code->relax, value, lines[i].address))
+                grow.push_back(i);
+        }
+        if(grow.empty())
+            break;
+        for(size_t g = 0; g < grow.size(); g++)
+            lines[grow[g]].wide = true;
+    }
+
+    for(size_t i = 0; i < lines.size(); i++)
+    {
+        const CachedLine* code = lines[i].code;
+        addUsers(code, i);
+        if(lines[i].wide)
+        {
+            byte longForm[5];
+            int size = Assembler::widen(code->code, code->relax, code->longOpcode, longForm);
+            image.insert(image.end(), longForm, longForm + size);
+        }
+        else
+            image.insert(image.end(), code->code, code->code + code->size);
+    }
+
+    for(size_t i = 0; i < lines.size(); i++)
+    {
+        if(!resolve(i))
+            return -1;
+    }
+    //a duplicate label isn't fatal, but the next run has to start over
+    valid = errorStack.empty();
+    return image.size();
+}
+
+//false if the line, or a line that refers to the label defined on it,
+//could change size with the labels
+bool IncrementalAssembler::fixedSize(const CachedLine* code)
+{
+    if(code->relax != RELAX_NONE)
+        return false;
+    if(code->label == -1)
+        return true;
+    const vector<size_t>& list = users[code->label];
+    for(size_t u = 0; u < list.size(); u++)
+    {
+        if(lines[list[u]].code->relax != RELAX_NONE)
+            return false;
+    }
+    return true;
+}
+
+//Replace lines [first, first + fresh.size()) with lines taking up the same
+//number of bytes. Returns -2 if that can't be done in place.
+int IncrementalAssembler::patch(size_t first, const vector<Line>& fresh)
+{
+    size_t last = first + fresh.size();
+    vector<int> changed;        //labels whose address may be different now
+
+    //a line that can grow or shrink needs layout() to settle it
+    for(size_t i = first; i < last; i++)
+    {
+        if(!fixedSize(lines[i].code) || !fixedSize(fresh[i - first].code))
+            return -2;
+    }
+
+    for(size_t i = first; i < last; i++)
+    {
+        const CachedLine* code = lines[i].code;
+        if(code->label != -1)
+        {
+            labelAddress[code->label] = -1;
+            changed.push_back(code->label);
+        }
+        removeUsers(code, i);
+    }
+
+    unsigned short address = lines[first].address;
+    for(size_t i = first; i < last; i++)
+    {
+        const CachedLine* code = fresh[i - first].code;
+        lines[i] = fresh[i - first];
+        lines[i].address = address;
+        if(code->label != -1)
+        {
+            if(labelAddress[code->label] != -1)
+                return -2;  //duplicate, let layout() sort it out
+            labelAddress[code->label] = address;
+            changed.push_back(code->label);
+        }
+        addUsers(code, i);
+        copy(code->code, code->code + code->size, image.begin() + (unsigned short)(address - offset));
+        address += code->size;
+    }
+
+    for(size_t i = first; i < last; i++)
+    {
+        if(!resolve(i))
+            return -1;
+    }
+    for(size_t c = 0; c < changed.size(); c++)
+    {
+        vector<size_t>& list = users[changed[c]];
+        for(size_t u = 0; u < list.size(); u++)
+        {
+            if(!resolve(list[u]))
+                return -1;
+        }
+    }
+    return image.size();
+}
+
+//Compare with the text of the last good run. Lines [0, prefix) and the last
+//suffix lines are unchanged, the new text in between is [first, last).
+void IncrementalAssembler::findChange(const string& now, size_t& prefix, size_t& suffix, size_t& first, size_t& last)
+{
+    size_t shorter = min(lastText.size(), now.size());
+
+    //memcmp in blocks first, it's a lot faster than a byte loop
+    size_t head = 0;
+    while(head + COMPARE_BLOCK <= shorter && !memcmp(&lastText[head], &now[head], COMPARE_BLOCK))
+        head += COMPARE_BLOCK;
+    while(head < shorter && lastText[head] == now[head])
+        head++;
+    size_t tail = 0;
+    size_t room = shorter - head;
+    while(tail + COMPARE_BLOCK <= room
+          && !memcmp(&lastText[lastText.size() - tail - COMPARE_BLOCK], &now[now.size() - tail - COMPARE_BLOCK], COMPARE_BLOCK))
+        tail += COMPARE_BLOCK;
+    while(tail < room && lastText[lastText.size() - 1 - tail] == now[now.size() - 1 - tail])
+        tail++;
+
+    //the line holding the first difference is where the change starts
+    size_t lo = 0;
+    size_t hi = lines.size();
+    while(hi - lo > 1)
+    {
+        size_t mid = (lo + hi) / 2;
+        if(lines[mid].start <= head)
+            lo = mid;
+        else
+            hi = mid;
+    }
+    prefix = lo;
+
+    //lines that start after a newline in the common tail are unchanged
+    suffix = 0;
+    while(lines.size() - suffix - 1 > prefix && lines[lines.size() - suffix - 1].start > lastText.size() - tail)
+        suffix++;
+
+    first = lines[prefix].start;
+    last = now.size();
+    if(suffix)
+        last = lines[lines.size() - suffix].start + now.size() - lastText.size();
+}
+
+int IncrementalAssembler::assemble()
+{
+    errorStack = stack<string>();
+    linesEncoded = 0;
+    if(inputBuffer == "")
+    {
+        errorStack.push("No code to assemble!");
+        valid = false;
+        return -1;
+    }
+
+    //macros and includes are expanded every run, the result is what gets compared
+    const string* source = &inputBuffer;
+    preprocessor.reset();
+    if(Preprocessor::needed(inputBuffer))
+    {
+        if(!preprocessor.process(inputBuffer, expandedBuffer))
+        {
+            moveErrors(preprocessor.getErrors(), &errorStack);
+            valid = false;
+            return -1;
+        }
+        source = &expandedBuffer;
+    }
+    const string& now = *source;
+
+    size_t prefix = 0;
+    size_t suffix = 0;
+    size_t first = 0;
+    size_t last = now.size();
+    if(valid && !lines.empty())
+        findChange(now, prefix, suffix, first, last);
+    else
+        lines.clear();
+
+    //split the new text, same as the Lexer does
+    string_view buffer(now);
+    vector<Line> fresh;
+    int oldBytes = 0;
+    int newBytes = 0;
+    bool encoded = true;
+    for(size_t pos = first; pos < last; )
+    {
+        size_t end = buffer.find('\n', pos);
+        if(end == string_view::npos || end > last)
+            end = last;
+        string_view text = buffer.substr(pos, end - pos);
+        Line line;
+        line.code = encode(text, hashLine(text));
+        line.start = pos;
+        line.address = 0;
+        line.wide = false;
+        if(line.code->size == -1)
+            encoded = false;
+        else
+            newBytes += line.code->size;
+        fresh.push_back(line);
+        pos = end + 1;
+    }
+
+    size_t oldLast = lines.size() - suffix;
+    for(size_t i = prefix; i < oldLast; i++)
+        oldBytes += lines[i].code->size;
+
+    //unchanged lines after the edit moved in the text
+    long shift = (long)now.size() - (long)lastText.size();
+    for(size_t i = oldLast; i < lines.size(); i++)
+        lines[i].start += shift;
+
+    int result = -2;
+    if(valid && encoded && oldLast - prefix == fresh.size() && oldBytes == newBytes && !fresh.empty())
+        result = patch(prefix, fresh);
+    if(result == -2)
+    {
+        //something moved, put the new lines in and lay everything out again
+        lines.erase(lines.begin() + prefix, lines.begin() + oldLast);
+        lines.insert(lines.begin() + prefix, fresh.begin(), fresh.end());
+        result = layout();
+    }
+
+    if(result == -1)
+    {
+        valid = false;
+        return -1;
+    }
+    lastText = now;
+    if(cache.size() + collisions.size() > lines.size() + CACHE_SLACK)
+        pruneCache();
+    return result;
+}
+
+//drop cached lines nothing points at any more
+void IncrementalAssembler::pruneCache()
+{
+    unordered_map<unsigned long long, CachedLine>::iterator it;
+    for(it = cache.begin(); it != cache.end(); ++it)
+        it->second.used = false;
+    for(list<CachedLine>::iterator c = collisions.begin(); c != collisions.end(); ++c)
+        c->used = false;
+    for(size_t i = 0; i < lines.size(); i++)
+        lines[i].code->used = true;
+    for(it = cache.begin(); it != cache.end(); )
+    {
+        if(it->second.used)
+            ++it;
+        else
+            it = cache.erase(it);
+    }
+    list<CachedLine>::iterator c;
+    for(c = collisions.begin(); c != collisions.end(); )
+    {
+        if(c->used)
+            ++c;
+        else
+            c = collisions.erase(c);
+    }
+}
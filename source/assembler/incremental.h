@@ -0,0 +1,99 @@
+#ifndef INCREMENTAL_H
+#define INCREMENTAL_H
+
+#include <map>
+#include <vector>
+#include <list>
+#include <stack>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include "assembler.h"
+
+using namespace std;
+
+//Drop-in for Assembler when the same buffer is assembled over and over with
+//small edits in between. The text is compared with the last good run to find
+//the lines that changed, and every distinct line is encoded once and cached
+//by its hash, so a run only parses lines it hasn't seen before. When the
+//edited lines take up the same number of bytes as before nothing else moves,
+//and only the edited lines and the references to labels they define get
+//patched. Otherwise the addresses are laid out again from the cache, which
+//is also the only way lines that can grow with their labels are handled.
+class IncrementalAssembler
+{
+public:
+    IncrementalAssembler();
+    int       assemble();                    //bytes generated, -1 on error
+    void      setText(string toSet);
+    void      setOffset(short offset);
+    byte*     getBinary();
+    stack<string>* getErrors();
+    map<string, short> getLabels();
+    int       getLinesEncoded();             //lines the last assemble had to parse
+    void      setIncludeCache(IncludeCache* cache);
+    void      addIncludePath(string path);
+private:
+    class CachedLine
+    {
+    public:
+        string text;            //as written, a hash match alone isn't enough
+        int    size;            //-1 if the line doesn't assemble
+        byte   code[3];
+        int    label;           //id of the label defined on this line, -1 if none
+        byte   refKind;         //REF_*
+        vector<byte> expr;      //operand, labels are ids
+        vector<int>  refLabels; //ids the operand uses, once each
+        byte   relax;           //RELAX_*, code is the short form
+        byte   longOpcode;
+        string error;
+        bool   used;            //for pruneCache()
+    };
+
+    class Line
+    {
+    public:
+        CachedLine*    code;
+        size_t         start;   //offset in the text
+        unsigned short address;
+        bool           wide;    //uses the long form of a RELAX_* line
+    };
+
+    static unsigned long long hashLine(string_view text);
+    static LabelHandle bindLabel(void* self, string_view name);
+    CachedLine* encode(string_view text, unsigned long long hash);
+    bool      reportErrors(size_t first, size_t last);
+    void      findChange(const string& now, size_t& prefix, size_t& suffix, size_t& first, size_t& last);
+    string    lineError(size_t line, string message);
+    int       layout();
+    int       patch(size_t first, const vector<Line>& fresh);
+    bool      resolve(size_t line);
+    byte      evaluate(size_t line, int& value, LabelHandle& missing);
+    int       lineSize(size_t line);
+    void      place(bool report);
+    bool      fixedSize(const CachedLine* code);
+    int       labelId(string_view name);
+    void      addUsers(const CachedLine* code, size_t line);
+    void      removeUsers(const CachedLine* code, size_t line);
+    void      pruneCache();
+
+    string    inputBuffer;
+    string    expandedBuffer;
+    string    lastText;                     //text of the last good run, after the preprocessor
+    Preprocessor preprocessor;
+    LabelBinder binder;                     //labels in expressions are ids
+    short     offset;
+    bool      valid;                        //lines, labels and image match the last good run
+    int       linesEncoded;
+    vector<Line> lines;
+    vector<byte> image;
+    unordered_map<unsigned long long, CachedLine> cache;
+    list<CachedLine> collisions;                    //lines whose hash slot was already taken
+    unordered_map<string, int> labelIds;            //upper case name -> id, kept across runs
+    vector<string> labelNames;                      //by id
+    vector<int>    labelAddress;                    //by id, -1 while not defined
+    vector<vector<size_t> > users;                  //by id, lines that reference the label
+    stack<string> errorStack;
+};
+
+#endif // INCREMENTAL_H
@@ -0,0 +1,61 @@
+#include "lexer.h"
+
+Lexer::Lexer(string_view source) : text(source), pos(0), lineNumber(0)
+{
+}
+
+void Lexer::skipSpace()
+{
+    while(pos < text.size() && isSpace(text[pos]))
+        pos++;
+}
+
+string_view Lexer::readWord()
+{
+    size_t start = pos;
+    while(pos < text.size() && !isSpace(text[pos]) && text[pos] != '\n' && text[pos] != ';')
+        pos++;
+    return text.substr(start, pos - start);
+}
+
+bool Lexer::next(SourceLine& line)
+{
+    if(pos >= text.size())
+        return false;
+
+    line.label = line.mnemonic = line.operand = string_view();
+    line.number = ++lineNumber;
+    size_t lineStart = pos;
+
+    skipSpace();
+    string_view word = readWord();
+    if(!word.empty() && word.back() == ':')
+    {
+        line.label = word.substr(0, word.size() - 1);
+        skipSpace();
+        word = readWord();
+    }
+    line.mnemonic = word;
+
+    //operand runs up to the comment or the end of the line
+    skipSpace();
+    size_t start = pos;
+    size_t end = pos;
+    while(pos < text.size() && text[pos] != '\n' && text[pos] != ';')
+    {
+        if(!isSpace(text[pos]))
+            end = pos + 1;
+        pos++;
+    }
+    line.operand = text.substr(start, end - start);
+
+    //drop the comment and the newline
+    while(pos < text.size() && text[pos] != '\n')
+        pos++;
+    line.text = text.substr(lineStart, pos - lineStart);
+    if(!line.text.empty() && line.text.back() == '\r')
+        line.text.remove_suffix(1);
+    if(pos < text.size())
+        pos++;
+    return true;
+}
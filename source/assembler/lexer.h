@@ -0,0 +1,44 @@
+#ifndef LEXER_H
+#define LEXER_H
+
+#include <string_view>
+
+using namespace std;
+
+//One source line split into its parts. Views point into the assembler's
+//input buffer, nothing is copied.
+class SourceLine
+{
+public:
+    string_view label;      //label defined on this line, without the ':'
+    string_view mnemonic;
+    string_view operand;    //everything up to the comment, trimmed
+    string_view text;       //the whole line, without the newline
+    int         number;     //1 based line number
+};
+
+class Lexer
+{
+public:
+    Lexer(string_view source);
+    bool next(SourceLine& line);    //false once the input is used up
+private:
+    string_view readWord();
+    void        skipSpace();
+
+    string_view text;
+    size_t      pos;
+    int         lineNumber;
+};
+
+inline bool isSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+inline char toUpper(char c)
+{
+    return (c >= 'a' && c <= 'z') ? c - ('a' - 'A') : c;
+}
+
+#endif // LEXER_H
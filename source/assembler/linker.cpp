@@ -0,0 +1,190 @@
+#include <thread>
+#include <atomic>
+#include "linker.h"
+#include "assembler.h"
+
+bool assembleModules(const vector<SourceFile>& sources, vector<ObjectModule>& modules, stack<string>& errors,
+                     unsigned int threads, const vector<string>& includePaths)
+{
+    modules.clear();
+    modules.resize(sources.size());
+    vector<stack<string> > moduleErrors(sources.size());
+    atomic<size_t> nextSource(0);
+    IncludeCache includes;      //headers shared by the modules are only prepared once
+
+    //each worker keeps one Assembler and pulls the next file off the list
+    auto worker = [&]()
+    {
+        Assembler asmber;
+        asmber.setIncludeCache(&includes);
+        for(size_t i = 0; i < includePaths.size(); i++)
+            asmber.addIncludePath(includePaths[i]);
+        for(size_t i = nextSource++; i < sources.size(); i = nextSource++)
+        {
+            modules[i].name = sources[i].name;
+            asmber.setText(sources[i].text);
+            if(!asmber.assembleModule(modules[i]))
+                swap(moduleErrors[i], *asmber.getErrors());
+        }
+    };
+
+    if(threads == 0)
+        threads = thread::hardware_concurrency();
+    if(threads > sources.size())
+        threads = sources.size();
+    if(threads <= 1)
+        worker();
+    else
+    {
+        vector<thread> pool;
+        for(unsigned int i = 0; i < threads; i++)
+            pool.push_back(thread(worker));
+        for(size_t i = 0; i < pool.size(); i++)
+            pool[i].join();
+    }
+
+    //report in file order, not in whatever order the threads finished
+    bool ok = true;
+    for(size_t i = 0; i < sources.size(); i++)
+    {
+        vector<string> messages;
+        for(; !moduleErrors[i].empty(); moduleErrors[i].pop())
+            messages.push_back(moduleErrors[i].top());
+        for(size_t m = messages.size(); m > 0; m--)
+            errors.push(sources[i].name + ": " + messages[m - 1]);
+        if(!messages.empty())
+            ok = false;
+    }
+    return ok;
+}
+
+Linker::Linker()
+{
+    this->offset = 0;
+}
+
+void Linker::setOffset(short offset)
+{
+    this->offset = offset;
+}
+
+void Linker::addModule(const ObjectModule* module)
+{
+    modules.push_back(module);
+}
+
+//give every module its address and collect the exports
+bool Linker::placeModules()
+{
+    unsigned int address = (unsigned short)offset;
+    bases.clear();
+    symbolMap.clear();
+    for(size_t i = 0; i < modules.size(); i++)
+    {
+        const ObjectModule* module = modules[i];
+        if(address + module->code.size() > 0x10000)
+        {
+            errorStack.push(module->name + ": Doesn't fit below $FFFF");
+            return false;
+        }
+        bases.push_back(address);
+
+        map<string, unsigned short>::const_iterator it;
+        for(it = module->exports.begin(); it != module->exports.end(); ++it)
+        {
+            if(symbolMap.find(it->first) != symbolMap.end())
+            {
+                errorStack.push(module->name + ": Label " + it->first + " is already defined by another module");
+                return false;
+            }
+            symbolMap[it->first] = address + it->second;
+        }
+        address += module->code.size();
+    }
+    return true;
+}
+
+bool Linker::applyRelocs(const ObjectModule* module, unsigned short base)
+{
+    for(size_t i = 0; i < module->relocs.size(); i++)
+    {
+        const Relocation& reloc = module->relocs[i];
+        unsigned int at = (base - (unsigned short)offset) + reloc.offset;
+        unsigned short target = base;
+
+        if(!reloc.symbol.empty())
+        {
+            map<string, short>::iterator it = symbolMap.find(reloc.symbol);
+            if(it == symbolMap.end())
+            {
+                errorStack.push(module->name + ": Couldn't resolve unkown label " + reloc.symbol);
+                return false;
+            }
+            target = it->second;
+        }
+        target += reloc.addend;
+
+        switch(reloc.kind)
+        {
+        case RELOC_REL8:
+        {
+            //offset is relative to the instruction after the branch
+            int branch = (short)(target - (unsigned short)(base + reloc.offset + 1));
+            if(branch < -128 || branch > 127)
+            {
+                errorStack.push(module->name + ": Branch target " + reloc.symbol + " is out of range!");
+                return false;
+            }
+            image[at] = (byte)branch;
+            break;
+        }
+        case RELOC_LO8:
+            image[at] = target & 0xFF;
+            break;
+        case RELOC_HI8:
+            image[at] = (target >> 8) & 0xFF;
+            break;
+        default:
+            image[at] = target & 0xFF;
+            image[at + 1] = (target >> 8) & 0xFF;
+            break;
+        }
+    }
+    return true;
+}
+
+int Linker::link()
+{
+    image.clear();
+    if(modules.empty())
+    {
+        errorStack.push("No modules to link!");
+        return -1;
+    }
+    if(!placeModules())
+        return -1;
+
+    for(size_t i = 0; i < modules.size(); i++)
+        image.insert(image.end(), modules[i]->code.begin(), modules[i]->code.end());
+    for(size_t i = 0; i < modules.size(); i++)
+    {
+        if(!applyRelocs(modules[i], bases[i]))
+            return -1;
+    }
+    return image.size();
+}
+
+byte* Linker::getBinary()
+{
+    return image.data();
+}
+
+stack<string>* Linker::getErrors()
+{
+    return &errorStack;
+}
+
+map<string, short> Linker::getLabels()
+{
+    return symbolMap;
+}
@@ -0,0 +1,47 @@
+#ifndef LINKER_H
+#define LINKER_H
+
+#include <map>
+#include <vector>
+#include <stack>
+#include <string>
+#include "objectmodule.h"
+
+using namespace std;
+
+class SourceFile
+{
+public:
+    string name;
+    string text;
+};
+
+//Assemble every source into its own module, spread over threads (0 = one per core).
+//Returns false if any failed, errors are prefixed with the file name.
+bool assembleModules(const vector<SourceFile>& sources, vector<ObjectModule>& modules, stack<string>& errors,
+                     unsigned int threads = 0, const vector<string>& includePaths = vector<string>());
+
+//Places modules one after another from the offset and resolves their symbols.
+class Linker
+{
+public:
+    Linker();
+    void      setOffset(short offset);              //load address of the first module
+    void      addModule(const ObjectModule* module);
+    int       link();                               //bytes in the image, -1 on error
+    byte*     getBinary();
+    stack<string>* getErrors();
+    map<string, short> getLabels();                 //final address of every export
+private:
+    bool      placeModules();
+    bool      applyRelocs(const ObjectModule* module, unsigned short base);
+
+    short     offset;
+    vector<const ObjectModule*> modules;
+    vector<unsigned short> bases;                   //load address per module
+    map<string, short> symbolMap;
+    vector<byte> image;
+    stack<string> errorStack;
+};
+
+#endif // LINKER_H
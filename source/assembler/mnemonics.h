@@ -0,0 +1,127 @@
+/**************************
+ * HEV6502 CPU Emulator
+ * MNEMONICS.H
+ * Assembler mnemonic table, a perfect hash built from opcodes.def
+ **************************/
+#ifndef MNEMONICS_H
+#define MNEMONICS_H
+
+#include <string_view>
+#include "../cpu/opinfo.h"
+
+/* Mnemonic lookup for the assembler, built at compile time from opcodes.def.
+ * A mnemonic packs into 15 bits (5 per letter, which also folds case) and a
+ * multiplicative hash with a seed searched for by the compiler maps each of
+ * them to its own slot. Lookup is one multiply, one load and one compare. */
+
+#define MNEMONIC_SLOTS 512
+#define MNEMONIC_MAX   64
+#define NO_MNEMONIC    0xFF
+
+class MnemonicRow
+{
+public:
+    unsigned int   key;
+    unsigned short modes;                   //bit per supported address mode
+    byte           opCodes[ADDR_MODES];     //opcode per address mode
+
+    constexpr bool has(byte mode) const { return (modes >> mode) & 1; }
+};
+
+class MnemonicTable
+{
+public:
+    MnemonicRow  rows[MNEMONIC_MAX];
+    int          count;
+    byte         slots[MNEMONIC_SLOTS];     //hash slot -> row, NO_MNEMONIC if empty
+    unsigned int seed;
+};
+
+class OpDef
+{
+public:
+    unsigned int key;
+    byte mode;
+    byte opCode;
+};
+
+constexpr unsigned int mnemonicKey(char a, char b, char c)
+{
+    return ((a & 0x1F) << 10) | ((b & 0x1F) << 5) | (c & 0x1F);
+}
+
+constexpr unsigned int mnemonicSlot(unsigned int key, unsigned int seed)
+{
+    return (key * seed) >> 23;     //top 9 bits, one of MNEMONIC_SLOTS
+}
+
+constexpr OpDef opDefs[] =
+{
+#define OP(code, mnem, addrMode, cyc, handler) { mnemonicKey(#mnem[0], #mnem[1], #mnem[2]), addrMode, code },
+#include "../cpu/opcodes.def"
+#undef OP
+};
+
+constexpr MnemonicTable buildMnemonicTable()
+{
+    MnemonicTable table {};
+
+    //one row per mnemonic, collecting its opcodes
+    for(const OpDef& def : opDefs)
+    {
+        int row = 0;
+        while(row < table.count && table.rows[row].key != def.key)
+            row++;
+        if(row == table.count)
+        {
+            table.rows[row].key = def.key;
+            table.count++;
+        }
+        table.rows[row].modes |= 1 << def.mode;
+        table.rows[row].opCodes[def.mode] = def.opCode;
+    }
+
+    //find a seed that puts every mnemonic in its own slot
+    for(unsigned int seed = 0x9E3779B1; ; seed += 2)
+    {
+        for(int i = 0; i < MNEMONIC_SLOTS; i++)
+            table.slots[i] = NO_MNEMONIC;
+        bool collision = false;
+        for(int row = 0; row < table.count && !collision; row++)
+        {
+            unsigned int slot = mnemonicSlot(table.rows[row].key, seed);
+            if(table.slots[slot] != NO_MNEMONIC)
+                collision = true;
+            else
+                table.slots[slot] = row;
+        }
+        if(!collision)
+        {
+            table.seed = seed;
+            return table;
+        }
+    }
+}
+
+constexpr MnemonicTable mnemonicTable = buildMnemonicTable();
+
+static_assert(mnemonicTable.count == 56, "opcodes.def should describe the 56 documented instructions");
+
+inline bool isLetter(char c)
+{
+    return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z');
+}
+
+//case insensitive, 0 if the text isn't an instruction
+inline const MnemonicRow* findMnemonic(std::string_view text)
+{
+    if(text.size() != 3 || !isLetter(text[0]) || !isLetter(text[1]) || !isLetter(text[2]))
+        return 0;
+    unsigned int key = mnemonicKey(text[0], text[1], text[2]);
+    byte row = mnemonicTable.slots[mnemonicSlot(key, mnemonicTable.seed)];
+    if(row == NO_MNEMONIC || mnemonicTable.rows[row].key != key)
+        return 0;
+    return &mnemonicTable.rows[row];
+}
+
+#endif // MNEMONICS_H
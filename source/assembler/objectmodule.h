@@ -0,0 +1,40 @@
+#ifndef OBJECTMODULE_H
+#define OBJECTMODULE_H
+
+#include <map>
+#include <vector>
+#include <string>
+
+#define byte unsigned char
+
+using namespace std;
+
+//The target is symbol + addend, or the module's load address + addend when
+//there's no symbol.
+#define RELOC_ABS16  0  //16 bit address
+#define RELOC_REL8   1  //branch offset
+#define RELOC_LO8    2  //low byte of the address
+#define RELOC_HI8    3  //high byte of the address
+
+class Relocation
+{
+public:
+    unsigned short offset;  //of the operand bytes inside the module
+    byte           kind;
+    string         symbol;  //imported name, empty for an address inside the module
+    int            addend;
+};
+
+//Output of Assembler::assembleModule(), code assembled at address 0 with
+//everything the linker needs to move it and hook it up to other modules.
+class ObjectModule
+{
+public:
+    string                     name;
+    vector<byte>               code;
+    map<string, unsigned short> exports;    //labels named by .export, offset inside the module
+    vector<string>             imports;     //labels used but not defined here
+    vector<Relocation>         relocs;
+};
+
+#endif // OBJECTMODULE_H
@@ -0,0 +1,478 @@
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include "preprocessor.h"
+#include "expression.h"
+
+static bool equalsNoCase(string_view text, const char* upper)
+{
+    size_t i = 0;
+    for(; i < text.size() && upper[i]; i++)
+    {
+        if(toUpper(text[i]) != upper[i])
+            return false;
+    }
+    return i == text.size() && !upper[i];
+}
+
+static string upperCopy(string_view text)
+{
+    string upper(text.size(), ' ');
+    for(size_t i = 0; i < text.size(); i++)
+        upper[i] = toUpper(text[i]);
+    return upper;
+}
+
+static string_view trim(string_view text)
+{
+    while(!text.empty() && isSpace(text.front()))
+        text.remove_prefix(1);
+    while(!text.empty() && isSpace(text.back()))
+        text.remove_suffix(1);
+    return text;
+}
+
+//comma separated, empty fields are kept
+static vector<string> splitList(string_view text)
+{
+    vector<string> items;
+    text = trim(text);
+    if(text.empty())
+        return items;
+    for(;;)
+    {
+        size_t comma = text.find(',');
+        items.push_back(string(trim(text.substr(0, comma))));
+        if(comma == string_view::npos)
+            return items;
+        text = text.substr(comma + 1);
+    }
+}
+
+//FNV-1a, 64 bit
+static unsigned long long hashText(string_view text)
+{
+    unsigned long long hash = 14695981039346656037ull;
+    for(size_t i = 0; i < text.size(); i++)
+    {
+        hash ^= (unsigned char)text[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+//one PreparedLine per line of text, directives picked out
+static shared_ptr<PreparedFile> splitLines(string text)
+{
+    shared_ptr<PreparedFile> file = make_shared<PreparedFile>();
+    file->text.swap(text);
+    string_view all(file->text);
+    for(size_t pos = 0; pos < all.size(); )
+    {
+        size_t end = all.find('\n', pos);
+        if(end == string_view::npos)
+            end = all.size();
+
+        PreparedLine line;
+        line.text = all.substr(pos, end - pos);
+        Lexer lexer(line.text);
+        SourceLine parts;
+        if(!lexer.next(parts))
+            parts.label = parts.mnemonic = parts.operand = string_view();
+        line.label = parts.label;
+        line.mnemonic = parts.mnemonic;
+        line.operand = parts.operand;
+        line.kind = LINE_TEXT;
+        if(equalsNoCase(line.mnemonic, ".MACRO"))
+            line.kind = LINE_MACRO;
+        else if(equalsNoCase(line.mnemonic, ".ENDM"))
+            line.kind = LINE_ENDM;
+        else if(equalsNoCase(line.mnemonic, ".REPT"))
+            line.kind = LINE_REPT;
+        else if(equalsNoCase(line.mnemonic, ".ENDR"))
+            line.kind = LINE_ENDR;
+        else if(equalsNoCase(line.mnemonic, ".INCLUDE"))
+            line.kind = LINE_INCLUDE;
+        file->lines.push_back(line);
+        pos = end + 1;
+    }
+    return file;
+}
+
+static LabelHandle anyLabel(void*, string_view)
+{
+    return 1; //only seen through ExprInfo::labels, which makes it an error
+}
+
+//an operand that has to be known now, with the assembler's number syntax
+static bool constantValue(string_view text, int& value, string& error)
+{
+    vector<byte> code;
+    ExprInfo info;
+    LabelBinder bind = { anyLabel, 0 };
+    if(!compileExpression(text, code, bind, info, error))
+        return false;
+    if(info.labels || info.pc)
+    {
+        error = "Labels and * aren't known yet";
+        return false;
+    }
+    value = info.value;
+    return true;
+}
+
+IncludeCache::IncludeCache() : hits(0)
+{
+}
+
+shared_ptr<const PreparedFile> IncludeCache::prepare(string text)
+{
+    unsigned long long hash = hashText(text);
+    {
+        lock_guard<mutex> guard(lock);
+        unordered_map<unsigned long long, shared_ptr<const PreparedFile> >::iterator it = files.find(hash);
+        if(it != files.end() && it->second->text == text)
+        {
+            hits++;
+            return it->second;
+        }
+    }
+
+    //split outside the lock, two threads preparing the same file just do it twice
+    shared_ptr<PreparedFile> file = splitLines(move(text));
+    lock_guard<mutex> guard(lock);
+    files[hash] = file;
+    return file;
+}
+
+int IncludeCache::getHits()
+{
+    lock_guard<mutex> guard(lock);
+    return hits;
+}
+
+Preprocessor::Preprocessor()
+{
+    this->cache = &ownCache;
+    this->output = 0;
+    this->calls = 0;
+}
+
+//every directive starts with a '.', without one there's nothing to do
+bool Preprocessor::needed(string_view text)
+{
+    return text.find('.') != string_view::npos;
+}
+
+void Preprocessor::setCache(IncludeCache* cache)
+{
+    this->cache = cache ? cache : &ownCache;
+}
+
+void Preprocessor::addIncludePath(string path)
+{
+    includePaths.push_back(path);
+}
+
+stack<string>* Preprocessor::getErrors()
+{
+    return &errorStack;
+}
+
+void Preprocessor::reset()
+{
+    macros.clear();
+    origins.clear();
+    fileNames.clear();
+    calls = 0;
+}
+
+string Preprocessor::location(int line)
+{
+    stringstream ss;
+    if(line < 1 || line > (int)origins.size())
+        ss << "Line " << line;
+    else if(origins[line - 1].fileName->empty())
+        ss << "Line " << origins[line - 1].line;
+    else
+        ss << *origins[line - 1].fileName << " line " << origins[line - 1].line;
+    return ss.str();
+}
+
+int Preprocessor::origin(int line, string& fileName)
+{
+    if(line < 1 || line > (int)origins.size())
+    {
+        fileName.clear();
+        return line;
+    }
+    fileName = *origins[line - 1].fileName;
+    return origins[line - 1].line;
+}
+
+bool Preprocessor::process(const string& text, string& out)
+{
+    reset();
+    output = &out;
+    out.clear();
+    out.reserve(text.size());
+
+    Frame frame;
+    //not through the cache, it only pays off for included files and would
+    //keep every version of the text an editor assembles
+    frame.file = splitLines(text);
+    frame.fileName = &mainName;
+    frame.params = 0;
+    frame.args = 0;
+    frame.call = 0;
+    frame.depth = 0;
+    bool ok = run(frame, 0, frame.file->lines.size());
+    output = 0;
+    return ok;
+}
+
+bool Preprocessor::fail(const Frame& frame, size_t at, string message)
+{
+    stringstream ss;
+    if(frame.fileName->empty())
+        ss << "Line " << at + 1 << ": " << message;
+    else
+        ss << *frame.fileName << " line " << at + 1 << ": " << message;
+    errorStack.push(ss.str());
+    return false;
+}
+
+void Preprocessor::emit(const Frame& frame, size_t at, string_view text)
+{
+    output->append(text.data(), text.size());
+    output->push_back('\n');
+    Origin origin;
+    origin.fileName = frame.fileName;
+    origin.line = at + 1;
+    origins.push_back(origin);
+}
+
+//\name is replaced with the macro argument, \@ with a number unique to the call
+string Preprocessor::substitute(const Frame& frame, string_view text)
+{
+    if(!frame.params || text.find('\\') == string_view::npos)
+        return string(text);
+
+    string result;
+    for(size_t i = 0; i < text.size(); i++)
+    {
+        if(text[i] != '\\' || i + 1 >= text.size())
+        {
+            result.push_back(text[i]);
+            continue;
+        }
+        if(text[i + 1] == '@')
+        {
+            result += to_string(frame.call);
+            i++;
+            continue;
+        }
+        size_t end = i + 1;
+        while(end < text.size() && (isalnum((unsigned char)text[end]) || text[end] == '_'))
+            end++;
+        string_view name = text.substr(i + 1, end - i - 1);
+        size_t p = 0;
+        while(p < frame.params->size() && upperCopy(name) != (*frame.params)[p])
+            p++;
+        if(name.empty() || p == frame.params->size())
+        {
+            result.push_back(text[i]);
+            continue;
+        }
+        if(p < frame.args->size())
+            result += (*frame.args)[p];
+        i = end - 1;
+    }
+    return result;
+}
+
+//matching close for the block opened at first, nested blocks skipped
+size_t Preprocessor::findEnd(const Frame& frame, size_t first, byte open, byte close)
+{
+    int nesting = 0;
+    const vector<PreparedLine>& lines = frame.file->lines;
+    for(size_t i = first + 1; i < lines.size(); i++)
+    {
+        if(lines[i].kind == open)
+            nesting++;
+        else if(lines[i].kind == close && nesting-- == 0)
+            return i;
+    }
+    return string::npos;
+}
+
+bool Preprocessor::defineMacro(const Frame& frame, size_t first, size_t end)
+{
+    const PreparedLine& line = frame.file->lines[first];
+    string_view operand = line.operand;
+    size_t split = 0;
+    while(split < operand.size() && !isSpace(operand[split]) && operand[split] != ',')
+        split++;
+    string name = upperCopy(operand.substr(0, split));
+    if(name.empty())
+        return fail(frame, first, ".macro needs a name");
+
+    Macro macro;
+    macro.params = splitList(operand.substr(split));
+    for(size_t i = 0; i < macro.params.size(); i++)
+        macro.params[i] = upperCopy(macro.params[i]);
+    macro.file = frame.file;
+    macro.fileName = frame.fileName;
+    macro.first = first + 1;
+    macro.last = end;
+    if(macros.find(name) != macros.end())
+        return fail(frame, first, "Macro " + name + " already exists");
+    macros[name] = macro;
+    return true;
+}
+
+bool Preprocessor::callMacro(const Frame& frame, size_t at, Macro& macro)
+{
+    const PreparedLine& line = frame.file->lines[at];
+    if(frame.depth >= MAX_NESTING)
+        return fail(frame, at, "Macros nested too deep");
+    if(!line.label.empty())
+        emit(frame, at, string(line.label) + ":");
+
+    vector<string> args = splitList(substitute(frame, line.operand));
+    if(args.size() > macro.params.size())
+        return fail(frame, at, "Too many arguments for macro " + upperCopy(line.mnemonic));
+
+    Frame inner;
+    inner.file = macro.file;
+    inner.fileName = macro.fileName;
+    inner.params = &macro.params;
+    inner.args = &args;
+    inner.call = ++calls;
+    inner.depth = frame.depth + 1;
+    return run(inner, macro.first, macro.last);
+}
+
+bool Preprocessor::readFile(const string& name, const string* from, string& path, string& text)
+{
+    vector<string> candidates;
+    size_t slash = from->find_last_of("/\\");
+    if(slash != string::npos)
+        candidates.push_back(from->substr(0, slash + 1) + name);
+    for(size_t i = 0; i < includePaths.size(); i++)
+        candidates.push_back(includePaths[i] + "/" + name);
+    candidates.push_back(name);
+
+    for(size_t i = 0; i < candidates.size(); i++)
+    {
+        ifstream in(candidates[i].c_str(), ios::in | ios::binary);
+        if(in)
+        {
+            path = candidates[i];
+            text.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+            return true;
+        }
+    }
+    return false;
+}
+
+bool Preprocessor::include(const Frame& frame, size_t at)
+{
+    string expanded = substitute(frame, frame.file->lines[at].operand);
+    string_view operand = trim(expanded);
+    if(frame.depth >= MAX_NESTING)
+        return fail(frame, at, "Includes nested too deep");
+    if(operand.size() < 2 || operand.front() != '"' || operand.back() != '"')
+        return fail(frame, at, ".include needs a file name in quotes");
+
+    string name(operand.substr(1, operand.size() - 2));
+    string path;
+    string text;
+    if(!readFile(name, frame.fileName, path, text))
+        return fail(frame, at, "Couldn't open " + name);
+
+    fileNames.push_back(unique_ptr<string>(new string(path)));
+    Frame inner;
+    inner.file = cache->prepare(text);
+    inner.fileName = fileNames.back().get();
+    inner.params = 0;
+    inner.args = 0;
+    inner.call = 0;
+    inner.depth = frame.depth + 1;
+    return run(inner, 0, inner.file->lines.size());
+}
+
+bool Preprocessor::run(const Frame& frame, size_t first, size_t last)
+{
+    const vector<PreparedLine>& lines = frame.file->lines;
+    for(size_t i = first; i < last; i++)
+    {
+        const PreparedLine& line = lines[i];
+        switch(line.kind)
+        {
+        case LINE_MACRO:
+        {
+            size_t end = findEnd(frame, i, LINE_MACRO, LINE_ENDM);
+            if(end == string::npos || end >= last)
+                return fail(frame, i, ".macro without .endm");
+            if(!defineMacro(frame, i, end))
+                return false;
+            i = end;
+            break;
+        }
+        case LINE_REPT:
+        {
+            size_t end = findEnd(frame, i, LINE_REPT, LINE_ENDR);
+            if(end == string::npos || end >= last)
+                return fail(frame, i, ".rept without .endr");
+            string count = substitute(frame, line.operand);
+            int times;
+            string error;
+            if(trim(count).empty())
+                return fail(frame, i, ".rept needs a count");
+            if(!constantValue(count, times, error))
+                return fail(frame, i, "Bad .rept count " + count + ": " + error);
+            if(times < 0 || times > MAX_REPT)
+                return fail(frame, i, "Bad .rept count " + count);
+            if(frame.depth >= MAX_NESTING)
+                return fail(frame, i, ".rept nested too deep");
+            Frame inner = frame;
+            inner.depth = frame.depth + 1;
+            for(long t = 0; t < times; t++)
+            {
+                if(!run(inner, i + 1, end))
+                    return false;
+            }
+            i = end;
+            break;
+        }
+        case LINE_ENDM:
+            return fail(frame, i, ".endm without .macro");
+        case LINE_ENDR:
+            return fail(frame, i, ".endr without .rept");
+        case LINE_INCLUDE:
+            if(!include(frame, i))
+                return false;
+            break;
+        default:
+        {
+            if(!line.mnemonic.empty() && !macros.empty())
+            {
+                map<string, Macro>::iterator it = macros.find(upperCopy(line.mnemonic));
+                if(it != macros.end())
+                {
+                    if(!callMacro(frame, i, it->second))
+                        return false;
+                    break;
+                }
+            }
+            if(frame.params)
+                emit(frame, i, substitute(frame, line.text));
+            else
+                emit(frame, i, line.text);
+            break;
+        }
+        }
+    }
+    return true;
+}
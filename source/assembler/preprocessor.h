@@ -0,0 +1,128 @@
+#ifndef PREPROCESSOR_H
+#define PREPROCESSOR_H
+
+#include <map>
+#include <vector>
+#include <stack>
+#include <string>
+#include <string_view>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include "lexer.h"
+
+#define byte unsigned char
+
+using namespace std;
+
+#define LINE_TEXT    0      //anything that isn't a directive, macro calls included
+#define LINE_MACRO   1
+#define LINE_ENDM    2
+#define LINE_REPT    3
+#define LINE_ENDR    4
+#define LINE_INCLUDE 5
+
+#define MAX_NESTING  16     //includes, macro calls and .rept blocks inside each other
+#define MAX_REPT     65536
+
+//One line of a source file, split once when the file is first seen.
+class PreparedLine
+{
+public:
+    string_view text;       //the whole line, without the newline
+    string_view label;
+    string_view mnemonic;
+    string_view operand;
+    byte        kind;
+};
+
+//A source file split into lines. Views point into text, which never changes
+//once the file is prepared, so it can be shared between threads.
+class PreparedFile
+{
+public:
+    string               text;
+    vector<PreparedLine> lines;
+};
+
+//Prepared files by content hash. One cache can be shared by every Assembler
+//in a build (see assembleModules()), so a header included by every module
+//is only split into lines once.
+class IncludeCache
+{
+public:
+    IncludeCache();
+    shared_ptr<const PreparedFile> prepare(string text);
+    int       getHits();                    //files found already prepared
+private:
+    mutex     lock;
+    unordered_map<unsigned long long, shared_ptr<const PreparedFile> > files;
+    int       hits;
+};
+
+//Expands .include, .macro/.endm and .rept/.endr into plain source for the
+//assembler, remembering where each output line came from.
+class Preprocessor
+{
+public:
+    Preprocessor();
+    static bool needed(string_view text);          //false if there can't be anything to expand
+    void      setCache(IncludeCache* cache);       //0 uses a private one
+    void      addIncludePath(string path);
+    bool      process(const string& text, string& output);
+    void      reset();                             //forget the last output
+    string    location(int line);                  //"Line N" or "file line N" for a line of the output
+    int       origin(int line, string& fileName);  //line N of fileName, which stays empty for the text itself
+    stack<string>* getErrors();
+private:
+    class Macro
+    {
+    public:
+        vector<string> params;
+        shared_ptr<const PreparedFile> file;
+        const string*  fileName;
+        size_t         first;      //body, in file->lines
+        size_t         last;
+    };
+
+    class Origin
+    {
+    public:
+        const string* fileName;     //empty for the text given to process()
+        int           line;
+    };
+
+    class Frame
+    {
+    public:
+        shared_ptr<const PreparedFile> file;
+        const string*  fileName;
+        const vector<string>* params;   //of the macro being expanded, or 0
+        const vector<string>* args;
+        int            call;            //number for \@
+        int            depth;
+    };
+
+    bool      run(const Frame& frame, size_t first, size_t last);
+    size_t    findEnd(const Frame& frame, size_t first, byte open, byte close);
+    bool      defineMacro(const Frame& frame, size_t first, size_t end);
+    bool      callMacro(const Frame& frame, size_t at, Macro& macro);
+    bool      include(const Frame& frame, size_t at);
+    string    substitute(const Frame& frame, string_view text);
+    void      emit(const Frame& frame, size_t at, string_view text);
+    bool      fail(const Frame& frame, size_t at, string message);
+    bool      readFile(const string& name, const string* from, string& path, string& text);
+
+    IncludeCache  ownCache;
+    IncludeCache* cache;
+    vector<string> includePaths;
+    map<string, Macro> macros;      //upper case name
+    vector<unique_ptr<string> > fileNames;
+    string        mainName;         //stays empty
+    string*       output;
+    vector<Origin> origins;         //per output line
+    int           calls;
+    stack<string> errorStack;
+};
+
+#endif // PREPROCESSOR_H
@@ -0,0 +1,112 @@
+#include "symboltable.h"
+#include "lexer.h"
+
+#define SYMBOL_TABLE_START 256
+
+SymbolTable::SymbolTable(Arena* arena) : arena(arena), capacity(SYMBOL_TABLE_START), count(0), generation(1)
+{
+    slots = new Slot[capacity]();
+}
+
+SymbolTable::~SymbolTable()
+{
+    delete[] slots;
+}
+
+//FNV-1a over the upper cased name
+unsigned int SymbolTable::hashName(string_view name)
+{
+    unsigned int hash = 2166136261u;
+    for(size_t i = 0; i < name.size(); i++)
+    {
+        hash ^= (unsigned char)toUpper(name[i]);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+//slot holding the name, or the empty slot it would go in
+SymbolTable::Slot* SymbolTable::probe(string_view name, unsigned int hash)
+{
+    unsigned int mask = capacity - 1;
+    for(unsigned int i = hash & mask; ; i = (i + 1) & mask)
+    {
+        Slot* slot = &slots[i];
+        if(slot->generation != generation)
+            return slot;
+        if(slot->hash != hash || slot->symbol->length != name.size())
+            continue;
+
+        size_t c = 0;
+        while(c < name.size() && toUpper(name[c]) == slot->symbol->name[c])
+            c++;
+        if(c == name.size())
+            return slot;
+    }
+}
+
+Symbol* SymbolTable::find(string_view name)
+{
+    Slot* slot = probe(name, hashName(name));
+    return slot->generation == generation ? slot->symbol : 0;
+}
+
+Symbol* SymbolTable::insert(string_view name)
+{
+    unsigned int hash = hashName(name);
+    Slot* slot = probe(name, hash);
+    if(slot->generation == generation)
+        return slot->symbol;
+
+    if((count + 1) * 2 > capacity)
+    {
+        grow();
+        slot = probe(name, hash);
+    }
+
+    char* interned = (char*)arena->allocate(name.size() + 1, 1);
+    for(size_t i = 0; i < name.size(); i++)
+        interned[i] = toUpper(name[i]);
+    interned[name.size()] = 0;
+
+    Symbol* symbol = arena->make<Symbol>(interned, (unsigned short)name.size(), (short)0, false);
+    slot->hash = hash;
+    slot->generation = generation;
+    slot->symbol = symbol;
+    count++;
+    return symbol;
+}
+
+void SymbolTable::clear()
+{
+    count = 0;
+    generation++;
+    if(generation == 0)
+    {
+        //wrapped, stale stamps could match again
+        for(unsigned int i = 0; i < capacity; i++)
+            slots[i].generation = 0;
+        generation = 1;
+    }
+}
+
+//double the table, keeping it at most half full
+void SymbolTable::grow()
+{
+    Slot* old = slots;
+    unsigned int oldCapacity = capacity;
+
+    capacity *= 2;
+    slots = new Slot[capacity]();
+    unsigned int mask = capacity - 1;
+    for(unsigned int i = 0; i < oldCapacity; i++)
+    {
+        if(old[i].generation != generation)
+            continue;
+        unsigned int s = old[i].hash & mask;
+        while(slots[s].generation == generation)
+            s = (s + 1) & mask;
+        slots[s] = old[i];
+    }
+    delete[] old;
+}
@@ -0,0 +1,62 @@
+#ifndef SYMBOLTABLE_H
+#define SYMBOLTABLE_H
+
+#include <string_view>
+#include "arena.h"
+
+using namespace std;
+
+//A label. Names are interned upper case in the arena, so a Symbol* stays
+//valid (and can be compared by pointer) until the table is cleared.
+class Symbol
+{
+public:
+    const char*    name;    //upper case, 0 terminated
+    unsigned short length;
+    short          value;   //address, once defined
+    bool           defined; //false while only referenced
+};
+
+//Case insensitive, open addressing with linear probing. Slots are stamped
+//with a generation so clear() doesn't have to touch the table.
+class SymbolTable
+{
+public:
+    SymbolTable(Arena* arena);
+    ~SymbolTable();
+
+    Symbol* find(string_view name);     //0 if the name was never seen
+    Symbol* insert(string_view name);   //find, or add as undefined
+    void    clear();
+
+    template<class F>
+    void forEach(F func)                //every symbol seen since the last clear
+    {
+        for(unsigned int i = 0; i < capacity; i++)
+        {
+            if(slots[i].generation == generation)
+                func(*slots[i].symbol);
+        }
+    }
+
+private:
+    class Slot
+    {
+    public:
+        unsigned int hash;
+        unsigned int generation;    //slot is empty unless this matches the table's
+        Symbol*      symbol;
+    };
+
+    static unsigned int hashName(string_view name);
+    Slot* probe(string_view name, unsigned int hash);
+    void  grow();
+
+    Arena*       arena;
+    Slot*        slots;
+    unsigned int capacity;          //always a power of two
+    unsigned int count;
+    unsigned int generation;
+};
+
+#endif // SYMBOLTABLE_H
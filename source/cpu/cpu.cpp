@@ -3,19 +3,87 @@
  * CPU.CPP
  * CPU function definitions
  **********************/
+#ifdef HEV_TRACE
+#include "../trace/tracewriter.h" //pulls in standard headers, keep it ahead of byte
+#endif
+#include <string.h>
+#include "scheduler.h" //std headers again, ahead of byte
 #include "cpu.h"
+#include "decimal.h"
+#include "opinfo.h"
+
+#ifdef HEV_PROFILE
+#define PROFILE_BEGIN()          unsigned long long profStart = profiler ? profiler->begin() : 0
+#define PROFILE_END(op, cycles)  if(profiler) profiler->end(op, cycles, profStart)
+#else
+#define PROFILE_BEGIN()
+#define PROFILE_END(op, cycles)
+#endif
+
+#ifdef HEV_PROFILE_PC
+#define PCPROFILE_BEGIN()         unsigned short profPC = PC
+#define PCPROFILE_END(op, cycles) if(pcProfiler) pcProfiler->record(profPC, op, cycles, PC)
+#else
+#define PCPROFILE_BEGIN()
+#define PCPROFILE_END(op, cycles)
+#endif
+
+#ifdef HEV_TRACE
+//done is what the loop has run since it last added to currentClocks
+#define TRACE_BEGIN(done)   if(tracer) tracer->record(this, currentClocks + (done))
+#else
+#define TRACE_BEGIN(done)
+#endif
 
 CPU::CPU(MemoryController* memory)
+{
+    setup(memory);
+    loadJumpTable<NMOS6502>();
+}
+
+void CPU::setup(MemoryController* memory)
 {
     cpuMem = memory;
+    mapPages();
     PC = cpuMem->getStartAddr();
     A = X = Y = ST = 0;
+    brkFlag = 0;
     updateStatusFlags();
     updateFlagReg();
     SP = 0xFF; //stack stars here, grows down.
     currentClocks = 0;
-    loadJumpTable();
-    //CPU initialized, but don't call execute yourself!
+    perf = PerfCounters();
+    jammed = false;
+    jamOnKil = true;
+    rmwDummyWrite = true;
+    clearDecimalOnInterrupt = false;
+    opSet = OPS_NMOS;
+    skipIdle = true;
+    idled = false;
+    idleClean = 0;
+    scheduler = 0;
+    irqPending = nmiPending = 0;
+#ifdef HEV_PROFILE
+    profiler = 0;
+#endif
+#ifdef HEV_PROFILE_PC
+    pcProfiler = 0;
+#endif
+#ifdef HEV_TRACE
+    tracer = 0;
+#endif
+    //CPU initialized once the variant loads its jump table, but don't call execute yourself!
+}
+
+void CPU::mapPages()
+{
+    zeroPageRam = cpuMem->getPagePointer(0);
+    stackRam = cpuMem->getPagePointer(1);
+}
+
+CPU::~CPU()
+{
+    //memory belongs to whoever created it
 }
 
 void CPU::clearFlags()
@@ -36,7 +104,33 @@ void CPU::clearRegs()
     X = 0;
     Y = 0;
     SP = 0xFF;
-    currentClocks = 0;
+    jammed = false;
+    irqPending = nmiPending = 0;
+    //the clock and the counters keep going, the scheduler depends on them
+}
+
+//Whether an instruction stores to memory or the stack. run() only skips
+//loops made of instructions that don't.
+static bool writesMemory(const char* mnem, byte mode)
+{
+    static const char* stores[] = { "STA", "STX", "STY", "STZ", "SAX", "SHA", "SHX", "SHY", "TAS",
+                                    "SLO", "RLA", "SRE", "RRA", "DCP", "ISC", "TRB", "TSB",
+                                    "PHA", "PHP", "PHX", "PHY", "JSR", "BRK" };
+    static const char* modifies[] = { "ASL", "LSR", "ROL", "ROR", "INC", "DEC" };
+    for(const char* store : stores)
+        if(!strcmp(mnem, store))
+            return true;
+    if(mode != IMP) //the accumulator forms only change A
+        for(const char* modify : modifies)
+            if(!strcmp(mnem, modify))
+                return true;
+    return false;
+}
+
+void CPU::setOp(byte code, FuncPtr handler, const char* mnem, byte mode)
+{
+    opTable[code] = handler;
+    opReadOnly[code] = !writesMemory(mnem, mode);
 }
 
 void CPU::loadJumpTable()
@@ -44,272 +138,294 @@ void CPU::loadJumpTable()
     for(int i = 0; i < 0x100; i++)
     {
         opTable[i] = 0;
+        opReadOnly[i] = 0;
     }
 
-    /* ADC */
-    opTable[0x69] = &CPU::adci;
-    opTable[0x65] = &CPU::adcz;
-    opTable[0x75] = &CPU::adczx;
-    opTable[0x6D] = &CPU::adca;
-    opTable[0x7D] = &CPU::adcax;
-    opTable[0x79] = &CPU::adcay;
-    opTable[0x61] = &CPU::adcix;
-    opTable[0x71] = &CPU::adciy;
-
-    /* AND */
-    opTable[0x29] = &CPU::andi;
-    opTable[0x25] = &CPU::andz;
-    opTable[0x35] = &CPU::andzx;
-    opTable[0x2D] = &CPU::anda;
-    opTable[0x3D] = &CPU::andax;
-    opTable[0x39] = &CPU::anday;
-    opTable[0x21] = &CPU::andix;
-    opTable[0x31] = &CPU::andiy;
-
-    /* ASL */
-    opTable[0x0A] = &CPU::aslac;
-    opTable[0x06] = &CPU::aslz;
-    opTable[0x16] = &CPU::aslzx;
-    opTable[0x0E] = &CPU::asla;
-    opTable[0x1E] = &CPU::aslax;
-
-
-    /* BCx */
-    opTable[0x90] = &CPU::bcc;
-    opTable[0xB0] = &CPU::bcs;
-    opTable[0xF0] = &CPU::beq;
-    opTable[0x30] = &CPU::bmi;
-    opTable[0xD0] = &CPU::bne;
-    opTable[0x10] = &CPU::bpl;
-    opTable[0x50] = &CPU::bvc;
-    opTable[0x70] = &CPU::bvs;
-
-    opTable[0x24] = &CPU::bitz;
-    opTable[0x2C] = &CPU::bita;
-
-    opTable[0x00] = &CPU::brk;
-
-    /* CLx */
-    opTable[0x18] = &CPU::clc;
-    opTable[0xD8] = &CPU::cld;
-    opTable[0x58] = &CPU::cli;
-    opTable[0xB8] = &CPU::clv;
-
-    /* CMP */
-    opTable[0xC9] = &CPU::cmpi;
-    opTable[0xC5] = &CPU::cmpz;
-    opTable[0xD5] = &CPU::cmpzx;
-    opTable[0xCD] = &CPU::cmpa;
-    opTable[0xDD] = &CPU::cmpax;
-    opTable[0xD9] = &CPU::cmpay;
-    opTable[0xC1] = &CPU::cmpix;
-    opTable[0xD1] = &CPU::cmpiy;
-
-    /* CPX */
-    opTable[0xE0] = &CPU::cpxi;
-    opTable[0xE4] = &CPU::cpxz;
-    opTable[0xEC] = &CPU::cpxa;
-
-    /* CPY */
-    opTable[0xC0] = &CPU::cpyi;
-    opTable[0xC4] = &CPU::cpyz;
-    opTable[0xCC] = &CPU::cpya;
-
-    /* DEC */
-    opTable[0xC6] = &CPU::decz;
-    opTable[0xD6] = &CPU::deczx;
-    opTable[0xCE] = &CPU::deca;
-    opTable[0xDE] = &CPU::decax;
-
-    opTable[0xCA] = &CPU::dex;
-
-    opTable[0x88] = &CPU::dey;
-
-    /* EOR */
-    opTable[0x49] = &CPU::eori;
-    opTable[0x45] = &CPU::eorz;
-    opTable[0x55] = &CPU::eorzx;
-    opTable[0x4D] = &CPU::eora;
-    opTable[0x5D] = &CPU::eorax;
-    opTable[0x59] = &CPU::eoray;
-    opTable[0x41] = &CPU::eorix;
-    opTable[0x51] = &CPU::eoriy;
-
-    /* INC */
-    opTable[0xE6] = &CPU::incz;
-    opTable[0xF6] = &CPU::inczx;
-    opTable[0xEE] = &CPU::inca;
-    opTable[0xFE] = &CPU::incax;
-
-    opTable[0xE8] = &CPU::inx;
-
-    opTable[0xC8] = &CPU::iny;
-
-    /* JMP */
-    opTable[0x4C] = &CPU::jmpa;
-    opTable[0x6C] = &CPU::jmpi;
-
-    /* JSR */
-    opTable[0x20] = &CPU::jsr;
-
-    /* LDA */
-    opTable[0xA9] = &CPU::ldai;
-    opTable[0xA5] = &CPU::ldaz;
-    opTable[0xB5] = &CPU::ldazx;
-    opTable[0xAD] = &CPU::ldaa;
-    opTable[0xBD] = &CPU::ldaax;
-    opTable[0xB9] = &CPU::ldaay;
-    opTable[0xA1] = &CPU::ldaix;
-    opTable[0xB1] = &CPU::ldaiy;
-
-    /* LDX */
-    opTable[0xA2] = &CPU::ldxi;
-    opTable[0xA6] = &CPU::ldxz;
-    opTable[0xB6] = &CPU::ldxzy;
-    opTable[0xAE] = &CPU::ldxa;
-    opTable[0xBE] = &CPU::ldxay;
-
-    /* LDY */
-    opTable[0xA0] = &CPU::ldyi;
-    opTable[0xA4] = &CPU::ldyz;
-    opTable[0xB4] = &CPU::ldyzx;
-    opTable[0xAC] = &CPU::ldya;
-    opTable[0xBC] = &CPU::ldyax;
-
-    /* LSR */
-    opTable[0x4A] = &CPU::lsrac;
-    opTable[0x46] = &CPU::lsrz;
-    opTable[0x56] = &CPU::lsrzx;
-    opTable[0x4E] = &CPU::lsra;
-    opTable[0x5E] = &CPU::lsrax;
-
-    /* NOP */
-    opTable[0xEA] = &CPU::nop;
-
-    /* ORA */
-    opTable[0x09] = &CPU::orai;
-    opTable[0x05] = &CPU::oraz;
-    opTable[0x15] = &CPU::orazx;
-    opTable[0x0D] = &CPU::oraa;
-    opTable[0x1D] = &CPU::oraax;
-    opTable[0x19] = &CPU::oraay;
-    opTable[0x01] = &CPU::oraix;
-    opTable[0x11] = &CPU::oraiy;
-
-    /* Pxx */
-    opTable[0x48] = &CPU::pha;
-    opTable[0x08] = &CPU::php;
-    opTable[0x68] = &CPU::pla;
-    opTable[0x28] = &CPU::plp;
-
-    /* ROL */
-    opTable[0x2A] = &CPU::rolac;
-    opTable[0x26] = &CPU::rolz;
-    opTable[0x36] = &CPU::rolzx;
-    opTable[0x2E] = &CPU::rola;
-    opTable[0x3E] = &CPU::rolax;
-
-    /* ROR */
-    opTable[0x6A] = &CPU::rorac;
-    opTable[0x66] = &CPU::rorz;
-    opTable[0x76] = &CPU::rorzx;
-    opTable[0x6E] = &CPU::rora;
-    opTable[0x7E] = &CPU::rorax;
-
-    /* RTI */
-    opTable[0x40] = &CPU::rti;
-
-    /* RTS */
-    opTable[0x60] = &CPU::rts;
-
-    /* SBC */
-    opTable[0xE9] = &CPU::sbci;
-    opTable[0xE5] = &CPU::sbcz;
-    opTable[0xF5] = &CPU::sbczx;
-    opTable[0xED] = &CPU::sbca;
-    opTable[0xFD] = &CPU::sbcax;
-    opTable[0xF9] = &CPU::sbcay;
-    opTable[0xE1] = &CPU::sbcix;
-    opTable[0xF1] = &CPU::sbciy;
-
-    /* SEC */
-    opTable[0x38] = &CPU::sec;
-
-    /* SED */
-    opTable[0xF8] = &CPU::sed;
-
-    /* SEI */
-    opTable[0x78] = &CPU::sei;
-
-    /* STA */
-    opTable[0x85] = &CPU::staz;
-    opTable[0x95] = &CPU::stazx;
-    opTable[0x8D] = &CPU::staa;
-    opTable[0x9D] = &CPU::staax;
-    opTable[0x99] = &CPU::staay;
-    opTable[0x81] = &CPU::staix;
-    opTable[0x91] = &CPU::staiy;
-
-    /* STX */
-    opTable[0x86] = &CPU::stxz;
-    opTable[0x96] = &CPU::stxzy;
-    opTable[0x8E] = &CPU::stxa;
-
-    /* STY */
-    opTable[0x84] = &CPU::styz;
-    opTable[0x94] = &CPU::styzx;
-    opTable[0x8C] = &CPU::stya;
-
-    /* Txx */
-    opTable[0xAA] = &CPU::tax;
-    opTable[0xA8] = &CPU::tay;
-    opTable[0xBA] = &CPU::tsx;
-    opTable[0x8A] = &CPU::txa;
-    opTable[0x9A] = &CPU::txs;
-    opTable[0x98] = &CPU::tya;
-
-}
-
-int CPU::execute()
+    //same table the assembler and the disassembler are built from
+#define OP(code, mnem, addrMode, cyc, handler) setOp(code, &CPU::handler, #mnem, addrMode);
+#include "opcodes.def"
+#undef OP
+}
+
+//the opcodes the NMOS chips don't document, all 256 entries are set after it
+void CPU::loadUndocumented()
+{
+#define OP(code, mnem, addrMode, cyc, handler) setOp(code, &CPU::handler, #mnem, addrMode);
+#include "opcodesundoc.def"
+#undef OP
+}
+
+template<>
+void CPU::loadJumpTable<NMOS6502>()
+{
+    loadJumpTable();
+    loadUndocumented();
+    decimal = getDecimalTables(DECIMAL_NMOS);
+}
+
+template<>
+void CPU::loadJumpTable<CMOS65C02>()
+{
+    loadJumpTable();
+#define OP(code, mnem, addrMode, cyc, handler) setOp(code, &CPU::handler, #mnem, addrMode);
+#include "opcodes65c02.def"
+#undef OP
+    decimal = getDecimalTables(DECIMAL_CMOS);
+    rmwDummyWrite = false;
+    clearDecimalOnInterrupt = true;
+    opSet = OPS_CMOS;
+}
+
+template<>
+void CPU::loadJumpTable<RP2A03>()
+{
+    loadJumpTable();
+    loadUndocumented();
+    decimal = getDecimalTables(DECIMAL_NONE);
+}
+
+unsigned long long CPU::execute()
 {
     //PC == current opcode, call the function at the jump table.
     int res = 0;
-    int cycles = 0;
+    unsigned long long cycles = 0;
     byte tmp = 0;
     while(res != -1 && PC != 0xFFFF) //while we haven't been ordered to HALT
     {
-        tmp = cpuMem->loadByte(PC);
+        PCPROFILE_BEGIN();
+        TRACE_BEGIN(cycles);
+        tmp = cpuMem->fetchByte(PC);
         ++PC;
+        PROFILE_BEGIN();
         res = (this->*opTable[tmp])(); //calling necessary function;
+        PROFILE_END(tmp, res);
+        PCPROFILE_END(tmp, res);
+        if(res == -1)
+            break;
+        cycles += res;
+        perf.instructions++;
+    }
+    currentClocks += cycles;
+    return cycles;
+}
+
+int CPU::run(int cycleBudget)
+{
+    //like execute(), but gives up after cycleBudget cycles so the caller
+    //can do something in between. Scheduled device events fire on time in
+    //here, the CPU runs in slices up to the next one.
+    int cycles = 0;
+    idled = false;
+    while(cycles < cycleBudget && PC != 0xFFFF)
+    {
+        int slice = cycleBudget - cycles;
+        if(scheduler)
+        {
+            unsigned long long due = scheduler->nextEvent();
+            if(due <= currentClocks)
+            {
+                scheduler->runDue(currentClocks);
+                continue;
+            }
+            if(due - currentClocks < (unsigned long long)slice)
+                slice = (int)(due - currentClocks);
+        }
+        cycles += runSlice(slice);
+    }
+    return cycles;
+}
+
+int CPU::runSlice(int cycleBudget)
+{
+    int cycles = 0;
+    idleClean = 0; //devices may have changed memory since the last slice
+    if(jammed)
+    {
+        idled = true;
+        currentClocks += cycleBudget;
+        return cycleBudget; //stuck until reset, the time passes anyway
+    }
+    while(cycles < cycleBudget && PC != 0xFFFF) //HALT, as in execute()
+    {
+        if(irqPending | nmiPending)
+        {
+            cycles += interrupt();
+            if(PC == 0xFFFF)
+                break; //no handler
+        }
+        unsigned short pc = PC;
+        PCPROFILE_BEGIN();
+        TRACE_BEGIN(cycles);
+        byte tmp = cpuMem->fetchByte(PC);
+        ++PC;
+        PROFILE_BEGIN();
+        int res = (this->*opTable[tmp])();
+        PROFILE_END(tmp, res);
+        PCPROFILE_END(tmp, res);
+        if(res == -1)
+        {
+            if(jammed)
+            {
+                idled = true;
+                cycles = cycleBudget;
+            }
+            break; //ordered to HALT, run() sees PC
+        }
         cycles += res;
+        perf.instructions++;
+        idleClean &= opReadOnly[tmp];
+        if(PC <= pc && skipIdle) //JMP * lands on itself
+            cycles = backwardJump(pc, cycles, cycleBudget);
+    }
+    currentClocks += cycles;
+    return cycles;
+}
+
+void CPU::irq()
+{
+    irqPending = 1;
+}
+
+void CPU::nmi()
+{
+    nmiPending = 1;
+}
+
+int CPU::interrupt()
+{
+    //requests are latched until taken, an IRQ waits for I to clear
+    unsigned short vector;
+    if(nmiPending)
+    {
+        nmiPending = 0;
+        vector = 0xFFFA;
+    }
+    else if(!intFlag)
+    {
+        irqPending = 0;
+        vector = 0xFFFE;
+    }
+    else
+        return 0;
+    //the frame BRK pushes, with B clear. rti() takes one off the PC it pulls
+    push(((PC + 1) >> 8) & 0xFF);
+    push((PC + 1) & 0xFF);
+    push(statusByte() & ~(FLAG_BRK));
+    intFlag = 1;
+    if(clearDecimalOnInterrupt)
+        decFlag = 0;
+    PC = cpuMem->loadWord16(vector);
+    if(!PC)
+        PC = 0xFFFF; //no handler installed, stop like brk() does
+    idleClean = 0;
+    perf.interrupts++;
+    return 7;
+}
+
+int CPU::backwardJump(unsigned short from, int cycles, int cycleBudget)
+{
+    if(from - PC > IDLE_LOOP_MAX)
+    {
+        idleClean = 0; //too long to be a wait loop, and it left any short one
+        return cycles;
     }
+    unsigned long long state = idleSnapshot();
+    if(from == idleBranch && idleClean && state == idleState)
+    {
+        //a whole pass wrote nothing and brought every register back, so the
+        //passes until something outside the CPU changes memory are all the
+        //same as this one. Skip the ones that fit in the budget, the rest
+        //runs normally and stops where it would have. The counters go up
+        //as if the skipped passes ran.
+        int pass = cycles - idleCycles;
+        int passes = (cycleBudget - cycles) / pass;
+        cycles += passes * pass;
+        perf.instructions += (perf.instructions - idlePerf.instructions) * passes;
+        perf.pageCrosses += (perf.pageCrosses - idlePerf.pageCrosses) * passes;
+        perf.branchesTaken += (perf.branchesTaken - idlePerf.branchesTaken) * passes;
+        idleCycles = cycles;
+        idlePerf = perf;
+        idled = true;
+        return cycles;
+    }
+    idleBranch = from;
+    idleState = state;
+    idleCycles = cycles;
+    idlePerf = perf;
+    idleClean = 1;
     return cycles;
 }
 
+unsigned long long CPU::idleSnapshot()
+{
+    //everything an instruction can change apart from memory, the flags are 0 or 1
+    byte flags = carryFlag | (zeroFlag << 1) | (intFlag << 2) | (decFlag << 3) | (overFlag << 4) | (signFlag << 5);
+    return A | (X << 8) | (Y << 16) | ((unsigned long long)SP << 24) | ((unsigned long long)PC << 32) | ((unsigned long long)flags << 48);
+}
+
+PerfCounters CPU::counters()
+{
+    PerfCounters now = perf;
+    now.cycles = currentClocks;
+    return now;
+}
+
 int CPU::step()
 {
     if(PC == 0xFFFF || PC >= codeEnd)
         return -1; //we're at the end of execution
+    if(scheduler && scheduler->nextEvent() <= currentClocks)
+        scheduler->runDue(currentClocks);
+    if(irqPending | nmiPending)
+    {
+        //taking an interrupt is a step of its own
+        int cycles = interrupt();
+        if(cycles)
+        {
+            currentClocks += cycles;
+            return cycles;
+        }
+    }
     //we're just executing one instruction
     int cycles = 0;
     byte tmp = 0;
-    tmp = cpuMem->loadByte(PC);
+    PCPROFILE_BEGIN();
+    TRACE_BEGIN(cycles);
+    tmp = cpuMem->fetchByte(PC);
     ++PC;
     if(!opTable[tmp]) //what instruction is this?
         return -1;
+    PROFILE_BEGIN();
     cycles += (this->*opTable[tmp])(); //call the function and wait
+    PROFILE_END(tmp, cycles);
+    PCPROFILE_END(tmp, cycles);
+    if(cycles > 0)
+    {
+        currentClocks += cycles;
+        perf.instructions++;
+    }
     return cycles;
 }
 
 unsigned short CPU::relative()
 {
+    //only called for branches that are taken
     char addr = cpuMem->loadByte(PC);
     unsigned short newAddr = PC + addr +1;
+    perf.branchesTaken++;
+    perf.pageCrosses += ((newAddr ^ (PC + 1)) & 0xFF00) != 0;
     //(addr < 0x80)? addr+= PC : addr += (PC - 256);
     //++PC; //useless, accounted for up top
     return newAddr;
 }
  
+unsigned short CPU::zeroPage()
+{
+    unsigned short addr = cpuMem->loadByte(PC);
+    ++PC;
+    return addr;
+}
+
 unsigned short CPU::zeroPageX()
 {
     unsigned short addr = cpuMem->loadByte(PC);
@@ -329,47 +445,32 @@ unsigned short CPU::zeroPageY()
 unsigned short CPU::absolute()
 {
     //full address
-    unsigned short tmpAddr = cpuMem->loadWord(PC);
-    unsigned short addr= (tmpAddr << 8) & 0xFF00; //high byte
-    addr += ((tmpAddr >> 8)& 0xFF);       //low  byte
-    //byte res = cpuMem->loadByte(addr);
+    unsigned short addr = cpuMem->loadWord16(PC);
     PC += 2;
     return addr;
 }
 unsigned short CPU::absoluteX()
 {
-    //full address + X with wrapping..maybe
-    unsigned short tmpAddr = cpuMem->loadWord(PC);
-    unsigned short addr = (tmpAddr << 8) & 0xFF00;
-    addr += ((tmpAddr >> 8) & 0xFF);
-    //(low + X > 255) ? low -= X : low += X;
-    //unsigned short addr = ((*++in) << 8); //high byte
-    addr += X & 0xFFFF;
-    //byte res = cpuMem->loadByte(addr);
+    //full address + X, wraps at $FFFF
+    unsigned short base = cpuMem->loadWord16(PC);
+    unsigned short addr = base + X;
+    perf.pageCrosses += ((addr ^ base) & 0xFF00) != 0;
     PC += 2;
     return addr;
 }
 unsigned short CPU::absoluteY()
 {
-    //full address + Y with wrapping..maybe
-    unsigned short tmpAddr = cpuMem->loadWord(PC);
-    unsigned short addr = (tmpAddr << 8) & 0xFF00;
-    addr += ((tmpAddr >> 8) & 0xFF);
-    addr += Y & 0xFFFF;
+    //full address + Y, wraps at $FFFF
+    unsigned short base = cpuMem->loadWord16(PC);
+    unsigned short addr = base + Y;
+    perf.pageCrosses += ((addr ^ base) & 0xFF00) != 0;
     PC += 2;
     return addr;
 }
 unsigned short CPU::indirect()
 {
     //used for jump, load address from address.
-    //load address one
-    unsigned short tmp = cpuMem->loadWord(PC);
-    unsigned short addrLow = (tmp >> 8) & 0xFF;
-    addrLow += ((tmp << 8) & 0xFF00);
-    unsigned short addrHigh = (addrLow + 1);
-
-    unsigned short target = (cpuMem->loadByte(addrHigh) << 8) & 0xFF00;
-    target += (cpuMem->loadByte(addrLow));
+    unsigned short target = cpuMem->loadWord16(cpuMem->loadWord16(PC));
     PC += 2;
     return target;
 
@@ -378,11 +479,8 @@ unsigned short CPU::indirect()
 unsigned short CPU::indexedIndirect()
 {
     //we're loading the address at ($00(x + *in))
-    unsigned short tmp = (cpuMem->loadByte(PC) + X) & 0xFF;
-
-    unsigned short target = (cpuMem->loadByte(tmp)) & 0xFF; //low
-    ++tmp;
-    target += (cpuMem->loadByte(tmp) << 8);                 //high
+    //the pointer wraps around in zero page
+    unsigned short target = loadZeroPageWord(cpuMem->loadByte(PC) + X);
     //now load the target
     ++PC;
     return target; 
@@ -393,11 +491,9 @@ unsigned short CPU::indirectIndexed()
     //rol ($2A), Y
     //The value $03 in Y is added to the address $C235 at addresses $002A and $002B for a sum of $C238. 
     //The value $2F at $C238 is shifted right (yielding $17) and written back to $C238.
-    byte targetTmp = cpuMem->loadByte(PC);
-    unsigned short tmp = (cpuMem->loadByte(targetTmp)) & 0xFF;
-    targetTmp++;
-    tmp += (cpuMem->loadByte(targetTmp) << 8);
-    tmp += Y;
+    unsigned short base = loadZeroPageWord(cpuMem->loadByte(PC));
+    unsigned short tmp = base + Y;
+    perf.pageCrosses += ((tmp ^ base) & 0xFF00) != 0;
     ++PC;
     return tmp;
 }
@@ -406,46 +502,47 @@ void CPU::updateFlagReg()
 {
     //compress flags into ST
     carryFlag = (carryFlag ? 1 : 0);
-    if(carryFlag)
-        ST &= FLAG_CARRY;
     zeroFlag = (zeroFlag ? 1 : 0);
-    if(zeroFlag)
-        ST &= FLAG_ZERO;
     intFlag = (intFlag ? 1 : 0);
-    if(intFlag)
-        ST &= FLAG_INT;
     decFlag = (decFlag ? 1 : 0);
-    if(decFlag)
-        ST &= FLAG_DEC;
     brkFlag = (brkFlag ? 1 : 0);
-    if(brkFlag)
-        ST &= FLAG_BRK;
     overFlag = (overFlag ? 1 : 0);
-    if(overFlag)
-        ST &= FLAG_OVER;
     signFlag = (signFlag ? 1 : 0);
-    if(signFlag)
-        ST &= FLAG_SIGN;
-
+    ST = statusByte();
 }
 
 void CPU::updateStatusFlags()
 {
-    //extract ST into flag vars
-    if(ST & FLAG_CARRY)
-        carryFlag = 1;
-    if(ST & FLAG_ZERO)
-        zeroFlag = 1;
-    if(ST & FLAG_INT)
-        intFlag = 1;
-    if(ST & FLAG_DEC)
-        decFlag = 1;
-    if(ST & FLAG_BRK)
-        brkFlag = 1;
-    if(ST & FLAG_OVER)
-        overFlag = 1;
-    if(ST & FLAG_SIGN)
-        signFlag = 1;
+    //extract ST into flag vars, clear ones too so RTI can turn I back off.
+    //B only exists in pushed copies, PLP and RTI don't bring it back; brkFlag
+    //is left to brk()
+    carryFlag = (ST & FLAG_CARRY) ? 1 : 0;
+    zeroFlag  = (ST & FLAG_ZERO) ? 1 : 0;
+    intFlag   = (ST & FLAG_INT) ? 1 : 0;
+    decFlag   = (ST & FLAG_DEC) ? 1 : 0;
+    overFlag  = (ST & FLAG_OVER) ? 1 : 0;
+    signFlag  = (ST & FLAG_SIGN) ? 1 : 0;
+}
+
+byte CPU::statusByte()
+{
+    //bit 5 is unused and always reads back as set
+    byte status = 0x20;
+    if(carryFlag)
+        status |= (FLAG_CARRY);
+    if(zeroFlag)
+        status |= (FLAG_ZERO);
+    if(intFlag)
+        status |= (FLAG_INT);
+    if(decFlag)
+        status |= (FLAG_DEC);
+    if(brkFlag)
+        status |= (FLAG_BRK);
+    if(overFlag)
+        status |= (FLAG_OVER);
+    if(signFlag)
+        status |= (FLAG_SIGN);
+    return status;
 }
 
 void CPU::push(byte toPush)
@@ -456,19 +553,24 @@ void CPU::push(byte toPush)
     {
         //STACK OVERFLOW!
     }
-    cpuMem->writeByte(toPush, (0x100 + SP));
+    if(stackRam)
+        stackRam[SP] = toPush;
+    else
+        cpuMem->writeByte(toPush, (0x100 + SP));
 }
 
 byte CPU::pull()
 {
     //stack pops up
-    byte retVal = cpuMem->loadByte(SP + 0x100);
+    byte retVal = stackRam ? stackRam[SP] : cpuMem->loadByte(SP + 0x100);
     SP++;
     return retVal;
 }
 
 byte CPU::addCOp(byte toAdd)
 {
+    if(decFlag)
+        return decimalOp(decimal->add, toAdd);
     unsigned short res = A + toAdd + carryFlag;
     overFlag = (!((A ^ toAdd) & 0x80) && ((A ^ res) & 0x80)) ? 1 : 0; //signed overflow
     carryFlag = res > 0xFF ? 1 : 0;  //unsigned overflow
@@ -477,6 +579,18 @@ byte CPU::addCOp(byte toAdd)
     return (byte)res;
 }
 
+//one load gives the decimal result and every flag ADC/SBC set
+byte CPU::decimalOp(const unsigned short* table, byte operand)
+{
+    unsigned short entry = table[decimalIndex(carryFlag ? 1 : 0, A, operand)];
+    byte flags = entry >> 8;
+    carryFlag = (flags & FLAG_CARRY) ? 1 : 0;
+    zeroFlag  = (flags & FLAG_ZERO) ? 1 : 0;
+    overFlag  = (flags & FLAG_OVER) ? 1 : 0;
+    signFlag  = (flags & FLAG_SIGN) ? 1 : 0;
+    return (byte)entry;
+}
+
 int CPU::adci()
 {
     //add with carry immediate
@@ -489,14 +603,14 @@ int CPU::adci()
 int CPU::adcz()
 {
     byte in = cpuMem->loadByte(PC);
-    A = (addCOp(cpuMem->loadByte(in)) & 0xFF);
+    A = (addCOp(loadZeroPage(in)) & 0xFF);
     ++PC;
     return 3;
 }
 
 int CPU::adczx()
 {
-    byte val = cpuMem->loadByte(zeroPageX());
+    byte val = loadZeroPage(zeroPageX());
     A = (addCOp(val) & 0xFF);
     return 4;
 }
@@ -560,13 +674,13 @@ int CPU::andz()
 {
     byte in = cpuMem->loadByte(PC);
     PC++;
-    A = andOp(cpuMem->loadByte(in));
+    A = andOp(loadZeroPage(in));
     return 3;
 }
 
 int CPU::andzx()
 {
-    byte res = cpuMem->loadByte(zeroPageX());
+    byte res = loadZeroPage(zeroPageX());
     A = andOp(res);
     return 4;
 }
@@ -625,27 +739,25 @@ int CPU::aslac() //accumulator
 
 int CPU::aslz()
 {
-    byte in = cpuMem->loadByte(PC);
-    PC++;
-    cpuMem->writeByte(aslOp(cpuMem->loadByte(in)), in);
+    modifyZeroPage<&CPU::aslOp>(zeroPage());
     return 5;
 }
 
 int CPU::aslzx()
 {
-    cpuMem->writeByte(aslOp(cpuMem->loadByte(zeroPageX())), zeroPageX());
+    modifyZeroPage<&CPU::aslOp>(zeroPageX());
     return 6;
 }
 
 int CPU::asla()
 {
-    cpuMem->writeByte(aslOp(cpuMem->loadByte(absolute())), absolute());
+    modify<&CPU::aslOp>(absolute());
     return 6;
 }
 
 int CPU::aslax()
 {
-    cpuMem->writeByte(aslOp(cpuMem->loadByte(absoluteX())), absoluteX());
+    modify<&CPU::aslOp>(absoluteX());
     return 7;
 }
 
@@ -682,7 +794,7 @@ int CPU::beq()
 
 int CPU::bitz()
 {
-    byte val = cpuMem->loadByte(cpuMem->loadByte((PC)));
+    byte val = loadZeroPage(cpuMem->loadByte(PC));
     ++PC;
     signFlag = (val >> 7) & 1;
     overFlag = (val >> 6) & 1;
@@ -737,8 +849,11 @@ int CPU::brk()
     push(ST);
     
     intFlag = 1;
-    PC = cpuMem->loadWord(0xFFFE);
-    PC--;
+    if(clearDecimalOnInterrupt)
+        decFlag = 0;
+    PC = cpuMem->loadWord16(0xFFFE);
+    if(!PC)
+        PC = 0xFFFF; //no handler installed, stop the way execute() expects
     return 7;
 }
 
@@ -787,8 +902,8 @@ int CPU::clv()
 
 byte CPU::cmpOp(byte toComp)
 {
-    char res = A - toComp;
-    carryFlag = (res >= 0? 1 : 0);
+    byte res = A - toComp;
+    carryFlag = (A >= toComp); //no borrow, unsigned
     signFlag = (res >> 7) &1;
     zeroFlag = !(res & 0xFF);
     return res;
@@ -807,13 +922,13 @@ int CPU::cmpz()
 {
     byte in = cpuMem->loadByte(PC);
     PC++;
-    cmpOp(cpuMem->loadByte(in));
+    cmpOp(loadZeroPage(in));
     return 3;
 }
 
 int CPU::cmpzx()
 {
-    cmpOp(cpuMem->loadByte(zeroPageX()));
+    cmpOp(loadZeroPage(zeroPageX()));
     return 4;
 }
 
@@ -850,8 +965,8 @@ int CPU::cmpiy()
 
 byte CPU::cpxOp(byte toComp)
 {
-    signed char res = X - toComp;
-    carryFlag = (res >= 0? 1: 0);
+    byte res = X - toComp;
+    carryFlag = (X >= toComp); //no borrow, unsigned
     signFlag = (res >> 7)&1;
     zeroFlag = !(res&0xFF);
     return res;
@@ -869,7 +984,7 @@ int CPU::cpxz()
 {
     byte in = cpuMem->loadByte(PC);
     PC++;
-    cpxOp(cpuMem->loadByte(in));
+    cpxOp(loadZeroPage(in));
     return 3;
 }
 
@@ -881,8 +996,8 @@ int CPU::cpxa()
 
 byte CPU::cpyOp(byte toComp)
 {
-    signed char res = Y - toComp;
-    carryFlag = (res >= 0? 1: 0);
+    byte res = Y - toComp;
+    carryFlag = (Y >= toComp); //no borrow, unsigned
     signFlag = (res >> 7)&1;
     zeroFlag = !(res&0xFF);
     return res;
@@ -900,7 +1015,7 @@ int CPU::cpyz()
 {
     byte in = cpuMem->loadByte(PC);
     PC++;
-    cpyOp(cpuMem->loadByte(in));
+    cpyOp(loadZeroPage(in));
     return 3;
 }
 
@@ -920,27 +1035,25 @@ byte CPU::decOp(byte toDec)
 
 int CPU::decz()
 {
-    byte in = cpuMem->loadByte(PC);
-    PC++;
-    cpuMem->writeByte(decOp(cpuMem->loadByte(in)), in);
+    modifyZeroPage<&CPU::decOp>(zeroPage());
     return 5;
 }
 
 int CPU::deczx()
 {
-    cpuMem->writeByte(decOp(cpuMem->loadByte(zeroPageX())), zeroPageX());
+    modifyZeroPage<&CPU::decOp>(zeroPageX());
     return 6;
 }
 
 int CPU::deca()
 {
-    cpuMem->writeByte(decOp(cpuMem->loadByte(absolute())), absolute());
+    modify<&CPU::decOp>(absolute());
     return 6;
 }
 
 int CPU::decax()
 {
-    cpuMem->writeByte(decOp(cpuMem->loadByte(absoluteX())), absoluteX());
+    modify<&CPU::decOp>(absoluteX());
     return 7;
 }
 
@@ -984,13 +1097,13 @@ int CPU::eorz()
 {
     byte in = cpuMem->loadByte(PC);
     PC++;
-    A = eorOp(cpuMem->loadByte(in));
+    A = eorOp(loadZeroPage(in));
     return 3;
 }
 
 int CPU::eorzx()
 {
-    byte res = cpuMem->loadByte(zeroPageX());
+    byte res = loadZeroPage(zeroPageX());
     A = eorOp(res);
     return 4;
 }
@@ -1040,28 +1153,25 @@ byte CPU::incOp(byte toinc)
 
 int CPU::incz()
 {
-    byte in = cpuMem->loadByte(PC);
-    PC++;
-    cpuMem->writeByte(incOp(cpuMem->loadByte(in)), in);
+    modifyZeroPage<&CPU::incOp>(zeroPage());
     return 5;
 }
 
 int CPU::inczx()
 {
-
-    cpuMem->writeByte(incOp(cpuMem->loadByte(zeroPageX())), zeroPageX());
+    modifyZeroPage<&CPU::incOp>(zeroPageX());
     return 6;
 }
 
 int CPU::inca()
 {
-    cpuMem->writeByte(incOp(cpuMem->loadByte(absolute())), absolute());
+    modify<&CPU::incOp>(absolute());
     return 6;
 }
 
 int CPU::incax()
 {
-    cpuMem->writeByte(incOp(cpuMem->loadByte(absoluteX())), absoluteX());
+    modify<&CPU::incOp>(absoluteX());
     return 7;
 }
 
@@ -1090,7 +1200,12 @@ int CPU::jmpa()
 
 int CPU::jmpi()
 {
-    PC = indirect();
+    //NMOS bug: a pointer at $xxFF takes its high byte from $xx00
+    unsigned short pointer = cpuMem->loadWord16(PC);
+    if((pointer & 0xFF) != 0xFF)
+        PC = cpuMem->loadWord16(pointer);
+    else
+        PC = cpuMem->loadByte(pointer) | (cpuMem->loadByte(pointer & 0xFF00) << 8);
     return 5;
 }
 
@@ -1115,7 +1230,7 @@ int CPU::ldaz()
 {
     byte in = cpuMem->loadByte(PC);
     PC++;
-    A = cpuMem->loadByte(in);
+    A = loadZeroPage(in);
     signFlag = (A >> 7) &1;
     zeroFlag = (!A);
     return 3;
@@ -1123,7 +1238,7 @@ int CPU::ldaz()
 
 int CPU::ldazx()
 {
-    A = cpuMem->loadByte(zeroPageX());
+    A = loadZeroPage(zeroPageX());
     signFlag = (A >> 7) &1;
     zeroFlag = (!A);
     return 4;
@@ -1183,7 +1298,7 @@ int CPU::ldxz()
 {
     byte in = cpuMem->loadByte(PC);
     PC++;
-    X = cpuMem->loadByte(in);
+    X = loadZeroPage(in);
     signFlag = (X >> 7) &1;
     zeroFlag = (!X);
     return 3;
@@ -1191,7 +1306,7 @@ int CPU::ldxz()
 
 int CPU::ldxzy()
 {
-    X = cpuMem->loadByte(zeroPageY());
+    X = loadZeroPage(zeroPageY());
     signFlag = (X >> 7) &1;
     zeroFlag = (!X);
     return 4;
@@ -1227,7 +1342,7 @@ int CPU::ldyz()
 {
     byte in = cpuMem->loadByte(PC);
     PC++;
-    Y = cpuMem->loadByte(in);
+    Y = loadZeroPage(in);
     signFlag = (Y >> 7) &1;
     zeroFlag = (!Y);
     return 3;
@@ -1235,7 +1350,7 @@ int CPU::ldyz()
 
 int CPU::ldyzx()
 {
-    Y = cpuMem->loadByte(zeroPageX());
+    Y = loadZeroPage(zeroPageX());
     signFlag = (Y >> 7) &1;
     zeroFlag = (!Y);
     return 4;
@@ -1276,37 +1391,35 @@ int CPU::lsrac() //accumulator
 
 int CPU::lsrz()
 {
-    byte in = cpuMem->loadByte(PC);
-    PC++;
-    cpuMem->writeByte(lsrOp(cpuMem->loadByte(in)), in);
+    modifyZeroPage<&CPU::lsrOp>(zeroPage());
     return 5;
 }
 
 int CPU::lsrzx()
 {
-    cpuMem->writeByte(lsrOp(cpuMem->loadByte(zeroPageX())), zeroPageX());
+    modifyZeroPage<&CPU::lsrOp>(zeroPageX());
     return 6;
 }
 
 int CPU::lsra()
 {
-    cpuMem->writeByte(lsrOp(cpuMem->loadByte(absolute())), absolute());
+    modify<&CPU::lsrOp>(absolute());
     return 6;
 }
 
 int CPU::lsrax()
 {
-    cpuMem->writeByte(lsrOp(cpuMem->loadByte(absoluteX())), absoluteX());
+    modify<&CPU::lsrOp>(absoluteX());
     return 7;
 }
 
 
 byte CPU::rolOp(byte toShift)
 {
-    //arithmetic shift left
-    byte res  = toShift;
-    carryFlag = (res >> 7) & 1;
-    res       = (res >> 1) & 0xFF;
+    //rotate left through carry
+    byte tmp  = carryFlag ? 1 : 0;
+    carryFlag = (toShift >> 7) & 1;
+    byte res  = ((toShift << 1) & 0xFF) | tmp;
     signFlag  = (res >> 7) &1;
     zeroFlag  = !(res);
     return res;
@@ -1320,27 +1433,25 @@ int CPU::rolac() //accumulator
 
 int CPU::rolz()
 {
-    byte in = cpuMem->loadByte(PC);
-    PC++;
-    cpuMem->writeByte(rolOp(cpuMem->loadByte(in)), in);
+    modifyZeroPage<&CPU::rolOp>(zeroPage());
     return 5;
 }
 
 int CPU::rolzx()
 {
-    cpuMem->writeByte(rolOp(cpuMem->loadByte(zeroPageX())), zeroPageX());
+    modifyZeroPage<&CPU::rolOp>(zeroPageX());
     return 6;
 }
 
 int CPU::rola()
 {
-    cpuMem->writeByte(rolOp(cpuMem->loadByte(absolute())), absolute());
+    modify<&CPU::rolOp>(absolute());
     return 6;
 }
 
 int CPU::rolax()
 {
-    cpuMem->writeByte(rolOp(cpuMem->loadByte(absoluteX())), absoluteX());
+    modify<&CPU::rolOp>(absoluteX());
     return 7;
 }
 
@@ -1350,6 +1461,31 @@ int CPU::nop()
     return 2;
 }
 
+//Undocumented (and 65C02 unused) NOPs that skip an operand
+int CPU::nopi()
+{
+    ++PC;
+    return 2;
+}
+
+int CPU::nopz()
+{
+    ++PC;
+    return 3;
+}
+
+int CPU::nopzx()
+{
+    ++PC;
+    return 4;
+}
+
+int CPU::nopa()
+{
+    PC += 2;
+    return 4;
+}
+
 byte CPU::oraOp(byte toOra)
 {
     //Used to perform common ora operations
@@ -1373,13 +1509,13 @@ int CPU::oraz()
 {
     byte in = cpuMem->loadByte(PC);
     PC++;
-    A = oraOp(cpuMem->loadByte(in));
+    A = oraOp(loadZeroPage(in));
     return 3;
 }
 
 int CPU::orazx()
 {
-    byte res = cpuMem->loadByte(zeroPageX());
+    byte res = loadZeroPage(zeroPageX());
     A = oraOp(res);
     return 4;
 }
@@ -1428,7 +1564,7 @@ int CPU::pha()
 int CPU::php()
 {
     updateFlagReg();
-    push(ST);
+    push(ST | (FLAG_BRK)); //B is always set in a pushed copy, only interrupts clear it
     return 3;
 }
 
@@ -1445,6 +1581,7 @@ int CPU::plp()
     updateFlagReg();
     ST = pull();
     updateStatusFlags();
+    updateFlagReg(); //ST without the pulled B
     return 4;
 
 }
@@ -1469,27 +1606,25 @@ int CPU::rorac() //accumulator
 
 int CPU::rorz()
 {
-    byte in = cpuMem->loadByte(PC);
-    PC++;
-    cpuMem->writeByte(rorOp(cpuMem->loadByte(in)), in);
+    modifyZeroPage<&CPU::rorOp>(zeroPage());
     return 5;
 }
 
 int CPU::rorzx()
 {
-    cpuMem->writeByte(rorOp(cpuMem->loadByte(zeroPageX())), zeroPageX());
+    modifyZeroPage<&CPU::rorOp>(zeroPageX());
     return 6;
 }
 
 int CPU::rora()
 {
-    cpuMem->writeByte(rorOp(cpuMem->loadByte(absolute())), absolute());
+    modify<&CPU::rorOp>(absolute());
     return 6;
 }
 
 int CPU::rorax()
 {
-    cpuMem->writeByte(rorOp(cpuMem->loadByte(absoluteX())), absoluteX());
+    modify<&CPU::rorOp>(absoluteX());
     return 7;
 }
 
@@ -1499,6 +1634,7 @@ int CPU::rti()
     byte tmp = pull();
     ST = tmp;
     updateStatusFlags();
+    updateFlagReg();
 
     PC = pull(); //get PC back
     PC += (pull() << 8);
@@ -1521,6 +1657,8 @@ int CPU::rts()
 
 byte CPU::sbcOp(byte toSub)
 {
+    if(decFlag)
+        return decimalOp(decimal->sub, toSub);
     short res = A - toSub - (1 -(carryFlag ? 1 : 0));
     carryFlag = (res >= 0 ? 1 : 0);
     overFlag = ((((A^res)&0x80)!=0 && ((A^toSub)&0x80)!=0)? 1 : 0);//(!((A ^ toSub) & 0x80) && ((A ^ res) & 0x80)) ? 1 : 0; //signed overflow
@@ -1543,13 +1681,13 @@ int CPU::sbcz()
 {
     byte in = cpuMem->loadByte(PC);
     PC++;
-    A = (sbcOp(cpuMem->loadByte(in)) & 0xFF);
+    A = (sbcOp(loadZeroPage(in)) & 0xFF);
     return 3;
 }
 
 int CPU::sbczx()
 {
-    byte val = cpuMem->loadByte(zeroPageX());
+    byte val = loadZeroPage(zeroPageX());
     A = (sbcOp(val) & 0xFF);
     return 4;
 }
@@ -1612,13 +1750,13 @@ int CPU::staz()
 {
     byte in = cpuMem->loadByte(PC);
     PC++;
-    cpuMem->writeByte(A, in);
+    writeZeroPage(A, in);
     return 3;
 }
 
 int CPU::stazx()
 {
-    cpuMem->writeByte(A, zeroPageX());
+    writeZeroPage(A, zeroPageX());
     return 4;
 }
 
@@ -1658,13 +1796,13 @@ int CPU::stxz()
 {
     byte in = cpuMem->loadByte(PC);
     PC++;
-    cpuMem->writeByte(X, in);
+    writeZeroPage(X, in);
     return 3;
 }
 
 int CPU::stxzy()
 {
-    cpuMem->writeByte(X, zeroPageY());
+    writeZeroPage(X, zeroPageY());
     return 4;
 }
 
@@ -1678,13 +1816,13 @@ int CPU::styz()
 {
     byte in = cpuMem->loadByte(PC);
     PC++;
-    cpuMem->writeByte(Y, in);
+    writeZeroPage(Y, in);
     return 3;
 }
 
 int CPU::styzx()
 {
-    cpuMem->writeByte(Y, zeroPageX());
+    writeZeroPage(Y, zeroPageX());
     return 4;
 }
 
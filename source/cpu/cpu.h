@@ -6,8 +6,19 @@
 #ifndef CPU_H
 #define CPU_H
 
+#ifdef HEV_PROFILE
+#include "profiler.h"
+#endif
+#ifdef HEV_PROFILE_PC
+#include "pcprofiler.h"
+#endif
+
+#include "variants.h"
+
 #define byte unsigned char
 
+#define IDLE_LOOP_MAX 32 //longest backward jump, in bytes, run() checks for an idle loop
+
 #define FLAG_CARRY 1 << 0 //Cary flag, used if a borrowed is required in subtraction, also used in shift and rotates
 #define FLAG_ZERO  1 << 1 //Zero flag, if op result is 0
 #define FLAG_INT   1 << 2 //Interrupt flag, they're disabled if this is set
@@ -16,25 +27,61 @@
 #define FLAG_OVER  1 << 6 //Overflow flag, used when arithmetic op produces result too large to be represented in a byte. (> 255)
 #define FLAG_SIGN  1 << 7 //Set if result of an operation is negative, clear if positive.
 
+#ifdef HEV_TRACE
+class TraceWriter;
+#endif
+class DecimalTables;
+class Scheduler;
+
+//Totals since the CPU was set up, for hosts working out throughput and
+//timing. Page crossings and taken branches are counted, but apart from
+//the 65C02's BRA they aren't charged their extra cycle.
+class PerfCounters
+{
+public:
+    PerfCounters() : cycles(0), instructions(0), interrupts(0), pageCrosses(0), branchesTaken(0) {}
+    unsigned long long cycles;          //currentClocks, filled in by CPU::counters()
+    unsigned long long instructions;
+    unsigned long long interrupts;      //IRQs and NMIs taken, not BRK
+    unsigned long long pageCrosses;     //indexed addresses and taken branches that landed in another page
+    unsigned long long branchesTaken;
+};
+
 class MemoryController
 {
 public:
     //virtual ~MemoryController();
     virtual unsigned short loadWord(unsigned short address) = 0;
+    //little-endian, the way the 6502 stores addresses. address + 1 wraps at $FFFF
+    virtual unsigned short loadWord16(unsigned short address) { return loadByte(address) | (loadByte(address + 1) << 8); }
     virtual byte  loadByte(unsigned short address) = 0;
+    virtual byte  fetchByte(unsigned short address) { return loadByte(address); } //opcode fetch
+    //for tracers and debuggers: no side effects and not counted. Memory with
+    //I/O behind its reads has to override it
+    virtual byte  peekByte(unsigned short address) { return loadByte(address); }
     virtual void  writeWord(unsigned short toStore, unsigned short address) = 0;
     virtual void  writeByte(byte toStore, unsigned short address) = 0;
     virtual unsigned short getStartAddr() = 0;
     virtual void  loadProgram(unsigned short startAddress, byte* toLoad, int size) = 0;
+    //Host pointer to the 256 bytes of a page that is plain RAM, so the CPU
+    //can skip the calls above for it. 0 when the page has I/O on it or its
+    //accesses must be seen here.
+    virtual byte* getPagePointer(byte) { return 0; }
 };
 
 
 class CPU
 {
   public:
-    CPU(MemoryController *memory);
+    CPU(MemoryController *memory); //an NMOS 6502
+    template<class Variant>
+    CPU(MemoryController *memory, Variant) { setup(memory); loadJumpTable<Variant>(); }
     ~CPU();
-    void loadJumpTable();
+    void setup(MemoryController *memory);
+    void loadJumpTable();             //documented NMOS opcodes
+    void loadUndocumented();          //the rest of the NMOS ones
+    template<class Variant>
+    void loadJumpTable();             //those plus what the variant changes, see variants.h
        byte X; // X register
        byte Y; // Y register
        byte A; // Accumulator
@@ -47,22 +94,55 @@ class CPU
        byte brkFlag;
        byte overFlag;
        byte signFlag;
-       int currentClocks;
+       unsigned long long currentClocks; //cycles run since setup(), what the scheduler goes by
+       PerfCounters perf;                //the other counters, see counters()
+       PerfCounters counters();          //all of them at once, cycles included
+       bool jammed; //hit a KIL opcode, execute() and step() stop on it
+       bool jamOnKil; //false runs KIL as a one byte NOP instead
        unsigned short PC; // Program Counter
        unsigned short codeEnd;
        unsigned short codeBegin;
        MemoryController* cpuMem; //CPU's memory, note it's abstract
+       const DecimalTables* decimal; //ADC/SBC results while decFlag is set
+       byte* zeroPageRam; //page 0 and 1 straight from getPagePointer(), 0 if
+       byte* stackRam;    //they go through cpuMem
+       void mapPages();   //asks cpuMem again, after it maps pages 0 and 1 differently
+#ifdef HEV_PROFILE
+       OpProfiler* profiler; //optional, counts opcodes as they run
+#endif
+#ifdef HEV_PROFILE_PC
+       PCProfiler* pcProfiler; //optional, samples the guest PC
+#endif
+#ifdef HEV_TRACE
+       TraceWriter* tracer; //optional, binary instruction trace
+#endif
 
        /* Status flag updates */
        void updateFlagReg();
        void updateStatusFlags();
+       byte statusByte(); //flags packed as the 6502 would push them
 
        /* push and pull */
        void push(byte toPush);
        byte pull();
 
+       /* zero page, direct when it's plain RAM */
+       byte loadZeroPage(byte address);
+       unsigned short loadZeroPageWord(byte address); //pointer, the high byte wraps to $00
+       void writeZeroPage(byte toWrite, byte address);
+
+       /* read-modify-write through one effective address, returns the new value */
+       template<byte (CPU::*Op)(byte)>
+       byte modify(unsigned short address);
+       template<byte (CPU::*Op)(byte)>
+       byte modifyZeroPage(byte address);
+       bool rmwDummyWrite; //NMOS writes the old value back before the new one, the 65C02 reads again
+       bool clearDecimalOnInterrupt; //the 65C02 clears D on BRK, IRQ and NMI, the NMOS leaves it
+
        /* Addressing Modes */
        unsigned short relative();
+       unsigned short zeroPage();
+       unsigned short zeroPageIndirect(); //65C02 (zp)
        unsigned short zeroPageX();
        unsigned short zeroPageY();
        unsigned short absolute();
@@ -74,6 +154,7 @@ class CPU
 
        /* ADC */
        byte addCOp(byte toAdD);
+       byte decimalOp(const unsigned short* table, byte operand);
        int adci();
        int adcz();
        int adczx();
@@ -219,6 +300,10 @@ class CPU
 
        /* NOP */
        int nop();
+       int nopi();
+       int nopz();
+       int nopzx();
+       int nopa();
 
        /* ORA */
        byte oraOp(byte toOra);
@@ -311,16 +396,203 @@ class CPU
        int txs();
        int tya();
 
+       /* 65C02, see opcodes65c02.def */
+       int adciz();
+       int andiz();
+       int biti();
+       int bitzx();
+       int bitax();
+       int bra();
+       int cmpiz();
+       int decac();
+       int eoriz();
+       int incac();
+       int jmpic();
+       int jmpix();
+       int ldaiz();
+       int oraiz();
+       int phx();
+       int phy();
+       int plx();
+       int ply();
+       int sbciz();
+       int staiz();
+       int stzz();
+       int stzzx();
+       int stza();
+       int stzax();
+       int trbz();
+       int trba();
+       int tsbz();
+       int tsba();
+       int nop1();
+       int nopa8();
+
+       /* Undocumented NMOS, see opcodesundoc.def */
+       void sloAt(unsigned short address);
+       int sloz();
+       int slozx();
+       int sloix();
+       int sloiy();
+       int sloa();
+       int sloax();
+       int sloay();
+
+       void rlaAt(unsigned short address);
+       int rlaz();
+       int rlazx();
+       int rlaix();
+       int rlaiy();
+       int rlaa();
+       int rlaax();
+       int rlaay();
+
+       void sreAt(unsigned short address);
+       int srez();
+       int srezx();
+       int sreix();
+       int sreiy();
+       int srea();
+       int sreax();
+       int sreay();
+
+       void rraAt(unsigned short address);
+       int rraz();
+       int rrazx();
+       int rraix();
+       int rraiy();
+       int rraa();
+       int rraax();
+       int rraay();
+
+       void dcpAt(unsigned short address);
+       int dcpz();
+       int dcpzx();
+       int dcpix();
+       int dcpiy();
+       int dcpa();
+       int dcpax();
+       int dcpay();
+
+       void iscAt(unsigned short address);
+       int iscz();
+       int isczx();
+       int iscix();
+       int isciy();
+       int isca();
+       int iscax();
+       int iscay();
+       int saxz();
+       int saxzy();
+       int saxix();
+       int saxa();
+       void laxOp(byte value);
+       int laxz();
+       int laxzy();
+       int laxix();
+       int laxiy();
+       int laxa();
+       int laxay();
+       int laxi();
+       int anci();
+       int alri();
+       int arri();
+       int axsi();
+       int xaai();
+       int shaiy();
+       int shaay();
+       int shyax();
+       int shxay();
+       int tasay();
+       int lasay();
+       int kil();
+
        //Opcode Table
        //Format will be int opFunc())
        //Return type is the number of cycles, in is input, out is output that might be needed. 
        typedef int (CPU::*FuncPtr)();
        FuncPtr opTable[256];
+       byte opReadOnly[256]; //1 if the opcode doesn't store to memory or the stack
+       byte opSet; //OPS_* in opinfo.h, the opcode names and modes for disassembling this CPU
+       void setOp(byte code, FuncPtr handler, const char* mnem, byte mode);
 
-       int execute();
+       unsigned long long execute(); //cycles until HALT
+       int run(int cycleBudget); //cycles used, can pass cycleBudget by the last instruction
+       int runSlice(int cycleBudget);
        int step();
+
+       /* Devices */
+       Scheduler* scheduler; //optional, run() and step() fire its events when they're due
+       void irq(); //taken before the next instruction once I is clear
+       void nmi(); //taken before the next instruction
+       byte irqPending;
+       byte nmiPending;
+       int interrupt(); //takes a pending one, returns its cycles or 0
+
+       /* Idle loops, see run() */
+       bool skipIdle; //skip loops that only read memory, turn off if reads have side effects
+       bool idled;    //the last run() ended in an idle loop or jammed
+       unsigned short idleBranch; //last backward jump and the state it left behind
+       unsigned long long idleState;
+       int idleCycles;
+       PerfCounters idlePerf;
+       byte idleClean; //nothing written since idleBranch
+       int backwardJump(unsigned short from, int cycles, int cycleBudget);
+       unsigned long long idleSnapshot();
        void clearFlags();
        void clearRegs();
 
  };
+
+template<> void CPU::loadJumpTable<NMOS6502>();
+template<> void CPU::loadJumpTable<CMOS65C02>();
+template<> void CPU::loadJumpTable<RP2A03>();
+
+inline byte CPU::loadZeroPage(byte address)
+{
+    return zeroPageRam ? zeroPageRam[address] : cpuMem->loadByte(address);
+}
+
+inline unsigned short CPU::loadZeroPageWord(byte address)
+{
+    if(zeroPageRam && address != 0xFF)
+        return zeroPageRam[address] | (zeroPageRam[address + 1] << 8);
+    return loadZeroPage(address) | (loadZeroPage(address + 1) << 8);
+}
+
+inline void CPU::writeZeroPage(byte toWrite, byte address)
+{
+    if(zeroPageRam)
+        zeroPageRam[address] = toWrite;
+    else
+        cpuMem->writeByte(toWrite, address);
+}
+
+//The extra bus access between the read and the write only matters to
+//memory mapped I/O, so it's only made with HEV_DUMMY_WRITES.
+template<byte (CPU::*Op)(byte)>
+inline byte CPU::modify(unsigned short address)
+{
+    byte val = cpuMem->loadByte(address);
+#ifdef HEV_DUMMY_WRITES
+    if(rmwDummyWrite)
+        cpuMem->writeByte(val, address);
+    else
+        cpuMem->loadByte(address);
+#endif
+    val = (this->*Op)(val);
+    cpuMem->writeByte(val, address);
+    return val;
+}
+
+template<byte (CPU::*Op)(byte)>
+inline byte CPU::modifyZeroPage(byte address)
+{
+    if(!zeroPageRam)
+        return modify<Op>(address);
+    byte val = (this->*Op)(zeroPageRam[address]);
+    zeroPageRam[address] = val;
+    return val;
+}
+
 #endif
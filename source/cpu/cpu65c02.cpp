@@ -0,0 +1,235 @@
+/**************************
+ * HEV6502 CPU Emulator
+ * CPU65C02.CPP
+ * Opcodes the 65C02 adds or changes, only in its jump table
+ **************************/
+#include "cpu.h"
+
+unsigned short CPU::zeroPageIndirect()
+{
+    //the pointer wraps around in zero page, like ($FF),Y does
+    unsigned short target = loadZeroPageWord(cpuMem->loadByte(PC));
+    ++PC;
+    return target;
+}
+
+int CPU::adciz()
+{
+    A = addCOp(cpuMem->loadByte(zeroPageIndirect()));
+    return 5;
+}
+
+int CPU::andiz()
+{
+    A = andOp(cpuMem->loadByte(zeroPageIndirect()));
+    return 5;
+}
+
+int CPU::biti()
+{
+    //immediate only sets Z
+    byte val = cpuMem->loadByte(PC);
+    ++PC;
+    zeroFlag = !(A & val);
+    return 2;
+}
+
+int CPU::bitzx()
+{
+    byte val = loadZeroPage(zeroPageX());
+    signFlag = (val >> 7) & 1;
+    overFlag = (val >> 6) & 1;
+    zeroFlag = !(A & val);
+    return 4;
+}
+
+int CPU::bitax()
+{
+    byte val = cpuMem->loadByte(absoluteX());
+    signFlag = (val >> 7) & 1;
+    overFlag = (val >> 6) & 1;
+    zeroFlag = !(A & val);
+    return 4;   //could be +1
+}
+
+int CPU::bra()
+{
+    //a cycle more when the target is on another page than the next instruction
+    unsigned short next = PC + 1;
+    PC = relative();
+    return ((PC ^ next) & 0xFF00) ? 4 : 3;
+}
+
+int CPU::cmpiz()
+{
+    cmpOp(cpuMem->loadByte(zeroPageIndirect()));
+    return 5;
+}
+
+int CPU::decac()
+{
+    A -= 1;
+    zeroFlag = !A;
+    signFlag = (A >> 7) & 1;
+    return 2;
+}
+
+int CPU::eoriz()
+{
+    A = eorOp(cpuMem->loadByte(zeroPageIndirect()));
+    return 5;
+}
+
+int CPU::incac()
+{
+    A += 1;
+    zeroFlag = !A;
+    signFlag = (A >> 7) & 1;
+    return 2;
+}
+
+int CPU::jmpic()
+{
+    //no page wrap bug, which costs a cycle
+    PC = indirect();
+    return 6;
+}
+
+int CPU::jmpix()
+{
+    unsigned short pointer = cpuMem->loadWord16(PC) + X;
+    PC = cpuMem->loadWord16(pointer);
+    return 6;
+}
+
+int CPU::ldaiz()
+{
+    A = cpuMem->loadByte(zeroPageIndirect());
+    signFlag = (A >> 7) & 1;
+    zeroFlag = !A;
+    return 5;
+}
+
+int CPU::oraiz()
+{
+    A = oraOp(cpuMem->loadByte(zeroPageIndirect()));
+    return 5;
+}
+
+int CPU::phx()
+{
+    push(X);
+    return 3;
+}
+
+int CPU::phy()
+{
+    push(Y);
+    return 3;
+}
+
+int CPU::plx()
+{
+    X = pull();
+    signFlag = (X >> 7) & 1;
+    zeroFlag = !X;
+    return 4;
+}
+
+int CPU::ply()
+{
+    Y = pull();
+    signFlag = (Y >> 7) & 1;
+    zeroFlag = !Y;
+    return 4;
+}
+
+int CPU::sbciz()
+{
+    A = sbcOp(cpuMem->loadByte(zeroPageIndirect()));
+    return 5;
+}
+
+int CPU::staiz()
+{
+    cpuMem->writeByte(A, zeroPageIndirect());
+    return 5;
+}
+
+int CPU::stzz()
+{
+    byte in = cpuMem->loadByte(PC);
+    PC++;
+    writeZeroPage(0, in);
+    return 3;
+}
+
+int CPU::stzzx()
+{
+    writeZeroPage(0, zeroPageX());
+    return 4;
+}
+
+int CPU::stza()
+{
+    cpuMem->writeByte(0, absolute());
+    return 4;
+}
+
+int CPU::stzax()
+{
+    cpuMem->writeByte(0, absoluteX());
+    return 5;
+}
+
+//TRB and TSB set Z from A AND memory, then clear or set A's bits in memory
+int CPU::trbz()
+{
+    byte in = cpuMem->loadByte(PC);
+    PC++;
+    byte val = loadZeroPage(in);
+    zeroFlag = !(A & val);
+    writeZeroPage(val & ~A, in);
+    return 5;
+}
+
+int CPU::trba()
+{
+    unsigned short addr = absolute();
+    byte val = cpuMem->loadByte(addr);
+    zeroFlag = !(A & val);
+    cpuMem->writeByte(val & ~A, addr);
+    return 6;
+}
+
+int CPU::tsbz()
+{
+    byte in = cpuMem->loadByte(PC);
+    PC++;
+    byte val = loadZeroPage(in);
+    zeroFlag = !(A & val);
+    writeZeroPage(val | A, in);
+    return 5;
+}
+
+int CPU::tsba()
+{
+    unsigned short addr = absolute();
+    byte val = cpuMem->loadByte(addr);
+    zeroFlag = !(A & val);
+    cpuMem->writeByte(val | A, addr);
+    return 6;
+}
+
+//Unused opcodes skip their operand bytes and do nothing else, the others
+//are shared with the NMOS undocumented NOPs
+int CPU::nop1()
+{
+    return 1;
+}
+
+int CPU::nopa8()
+{
+    PC += 2;
+    return 8;
+}
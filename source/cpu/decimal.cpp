@@ -0,0 +1,125 @@
+/**************************
+ * HEV6502 CPU Emulator
+ * DECIMAL.CPP
+ * Builds the decimal mode tables, NMOS behaviour for invalid BCD too
+ **************************/
+#include "cpu.h"
+#include "decimal.h"
+
+static unsigned short entry(int result, bool carry, bool zero, bool over, bool sign)
+{
+    byte flags = 0;
+    if(carry)
+        flags |= FLAG_CARRY;
+    if(zero)
+        flags |= FLAG_ZERO;
+    if(over)
+        flags |= FLAG_OVER;
+    if(sign)
+        flags |= FLAG_SIGN;
+    return (result & 0xFF) | (flags << 8);
+}
+
+static unsigned short binaryAdd(int a, int value, int carry)
+{
+    int sum = a + value + carry;
+    bool over = (~(a ^ value) & (a ^ sum) & 0x80) != 0;
+    return entry(sum, sum > 0xFF, (sum & 0xFF) == 0, over, (sum & 0x80) != 0);
+}
+
+static unsigned short binarySub(int a, int value, int carry)
+{
+    unsigned int diff = (unsigned int)(a - value - (1 - carry));
+    bool over = ((a ^ diff) & 0x80) && ((a ^ value) & 0x80);
+    return entry(diff, diff < 0x100, (diff & 0xFF) == 0, over, (diff & 0x80) != 0);
+}
+
+//NMOS takes Z from the binary sum and N and V from the sum with only the
+//low digit adjusted. The 65C02 gets the same result and C, with N and Z
+//from the result.
+static unsigned short decimalAdd(byte kind, int a, int value, int carry)
+{
+    int binary = a + value + carry;
+    int low = (a & 0x0F) + (value & 0x0F) + carry;
+    if(low > 9)
+        low += 6;
+    int sum = (low & 0x0F) + (a & 0xF0) + (value & 0xF0) + (low > 0x0F ? 0x10 : 0);
+    bool sign = (sum & 0x80) != 0;
+    bool over = ((a ^ sum) & 0x80) && !((a ^ value) & 0x80);
+    if((sum & 0x1F0) > 0x90)
+        sum += 0x60;
+    bool carryOut = (sum & 0xFF0) > 0xF0;
+    if(kind == DECIMAL_CMOS)
+        return entry(sum, carryOut, (sum & 0xFF) == 0, over, (sum & 0x80) != 0);
+    return entry(sum, carryOut, (binary & 0xFF) == 0, over, sign);
+}
+
+//V and C come from the binary difference on both. NMOS takes N and Z from
+//it too, the 65C02 adjusts differently and takes them from the result.
+static unsigned short decimalSub(byte kind, int a, int value, int carry)
+{
+    int borrow = 1 - carry;
+    unsigned int binary = (unsigned int)(a - value - borrow);
+    bool over = ((a ^ binary) & 0x80) && ((a ^ value) & 0x80);
+    int low = (a & 0x0F) - (value & 0x0F) - borrow;
+    int diff;
+    if(kind == DECIMAL_CMOS)
+    {
+        diff = a - value - borrow;
+        if(diff < 0)
+            diff -= 0x60;
+        if(low < 0)
+            diff -= 0x06;
+        return entry(diff, binary < 0x100, (diff & 0xFF) == 0, over, (diff & 0x80) != 0);
+    }
+    if(low & 0x10)
+        diff = ((low - 6) & 0x0F) | ((a & 0xF0) - (value & 0xF0) - 0x10);
+    else
+        diff = (low & 0x0F) | ((a & 0xF0) - (value & 0xF0));
+    if(diff & 0x100)
+        diff -= 0x60;
+    return entry(diff, binary < 0x100, (binary & 0xFF) == 0, over, (binary & 0x80) != 0);
+}
+
+static DecimalTables* buildDecimalTables(byte kind)
+{
+    DecimalTables* tables = new DecimalTables;
+    for(int carry = 0; carry < 2; carry++)
+    {
+        for(int a = 0; a < 0x100; a++)
+        {
+            for(int value = 0; value < 0x100; value++)
+            {
+                unsigned int index = decimalIndex(carry, a, value);
+                if(kind == DECIMAL_NONE)
+                {
+                    tables->add[index] = binaryAdd(a, value, carry);
+                    tables->sub[index] = binarySub(a, value, carry);
+                }
+                else
+                {
+                    tables->add[index] = decimalAdd(kind, a, value, carry);
+                    tables->sub[index] = decimalSub(kind, a, value, carry);
+                }
+            }
+        }
+    }
+    return tables;
+}
+
+const DecimalTables* getDecimalTables(byte kind)
+{
+    //shared by every CPU of a kind and never freed, 512K each
+    if(kind == DECIMAL_CMOS)
+    {
+        static const DecimalTables* cmos = buildDecimalTables(DECIMAL_CMOS);
+        return cmos;
+    }
+    if(kind == DECIMAL_NONE)
+    {
+        static const DecimalTables* none = buildDecimalTables(DECIMAL_NONE);
+        return none;
+    }
+    static const DecimalTables* nmos = buildDecimalTables(DECIMAL_NMOS);
+    return nmos;
+}
@@ -0,0 +1,34 @@
+/**************************
+ * HEV6502 CPU Emulator
+ * DECIMAL.H
+ * Decimal mode ADC/SBC, every result worked out once and looked up
+ **************************/
+#ifndef DECIMAL_H
+#define DECIMAL_H
+
+#define byte unsigned char
+
+#define DECIMAL_ENTRIES 0x20000     //carry, A and the operand
+
+#define DECIMAL_NMOS 0      //N and V from the half adjusted sum, Z from the binary one
+#define DECIMAL_CMOS 1      //65C02, N and Z from the result
+#define DECIMAL_NONE 2      //2A03, binary results whatever D says
+#define DECIMAL_KINDS 3
+
+//Each entry is the new A in the low byte and the N, V, Z and C flags in
+//the high byte, in their FLAG_* positions.
+class DecimalTables
+{
+public:
+    unsigned short add[DECIMAL_ENTRIES];
+    unsigned short sub[DECIMAL_ENTRIES];
+};
+
+const DecimalTables* getDecimalTables(byte kind);  //built the first time it's asked for
+
+inline unsigned int decimalIndex(byte carry, byte a, byte operand)
+{
+    return (carry << 16) | (a << 8) | operand;
+}
+
+#endif // DECIMAL_H
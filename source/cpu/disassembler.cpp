@@ -0,0 +1,84 @@
+/**************************
+ * HEV6502 CPU Emulator
+ * DISASSEMBLER.CPP
+ * Table driven disassembler
+ **************************/
+#include "disassembler.h"
+
+//What goes around the operand in each address mode, and how many hex
+//digits it has. REL prints the branch target rather than the offset.
+class ModeFormat
+{
+public:
+    const char* prefix;
+    const char* suffix;
+    int         digits;
+};
+
+static const ModeFormat modeFormats[ADDR_MODES] =
+{
+    { " #$", "",    2 },    //IMM
+    { " $",  "",    2 },    //ZP
+    { " $",  ",X",  2 },    //ZPX
+    { " $",  ",Y",  2 },    //ZPY
+    { " $",  "",    4 },    //ABS
+    { " $",  ",X",  4 },    //ABX
+    { " $",  ",Y",  4 },    //ABY
+    { " ($", ")",   4 },    //IND
+    { " ($", ",X)", 2 },    //IDX
+    { " ($", "),Y", 2 },    //IDY
+    { "",    "",    0 },    //IMP
+    { " $",  "",    4 },    //REL
+    { " ($", ")",   2 },    //IZP
+    { " ($", ",X)", 4 },    //IAX
+};
+
+static const char hexDigits[] = "0123456789ABCDEF";
+
+static char* putText(char* out, const char* text)
+{
+    while(*text)
+        *out++ = *text++;
+    return out;
+}
+
+static char* putHex(char* out, unsigned int value, int digits)
+{
+    for(int shift = (digits - 1) * 4; shift >= 0; shift -= 4)
+        *out++ = hexDigits[(value >> shift) & 0xF];
+    return out;
+}
+
+int disassemble(const byte* code, unsigned short pc, char* out, byte opSet)
+{
+    const OpInfo& info = getOpInfo(opSet)[code[0]];
+    if(!info.name)
+    {
+        out = putHex(putText(out, ".DB $"), code[0], 2);
+        *out = 0;
+        return 1;
+    }
+
+    out = putText(out, info.name);
+    const ModeFormat& format = modeFormats[info.mode];
+    if(format.digits)
+    {
+        unsigned int value;
+        if(info.mode == REL)
+            value = (unsigned short)(pc + 2 + (signed char)code[1]);
+        else if(info.length == 3)
+            value = code[1] | (code[2] << 8);
+        else
+            value = code[1];
+        out = putText(putHex(putText(out, format.prefix), value, format.digits), format.suffix);
+    }
+    *out = 0;
+    return info.length;
+}
+
+string disassemble(const byte* code, unsigned short pc, byte opSet)
+{
+    char text[DISASM_MAX];
+    disassemble(code, pc, text, opSet);
+    return text;
+}
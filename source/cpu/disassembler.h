@@ -0,0 +1,23 @@
+/**************************
+ * HEV6502 CPU Emulator
+ * DISASSEMBLER.H
+ * Table driven disassembler, built from the same opcode tables as the
+ * CPU's jump table and the assembler's mnemonics
+ **************************/
+#ifndef DISASSEMBLER_H
+#define DISASSEMBLER_H
+
+#include <string>
+#include "opinfo.h"
+
+#define DISASM_MAX 16   //longest text disassemble() writes, with the 0
+
+using namespace std;
+
+//Writes the instruction at code as text to out and returns its length in
+//bytes. code needs that many bytes, at most 3. pc is where the instruction
+//is, for branch targets. opSet picks the variant's opcodes, see opinfo.h.
+int    disassemble(const byte* code, unsigned short pc, char* out, byte opSet = OPS_NMOS);
+string disassemble(const byte* code, unsigned short pc, byte opSet = OPS_NMOS);
+
+#endif // DISASSEMBLER_H
@@ -0,0 +1,56 @@
+/**************************
+ * HEV6502 CPU Emulator
+ * OPINFO.CPP
+ * Builds the opcode information table
+ **************************/
+#include "opinfo.h"
+
+class OpInfoTable
+{
+public:
+    OpInfo ops[256];
+};
+
+static const char* modeNames[ADDR_MODES] =
+{
+    "IMM", "ZP", "ZPX", "ZPY", "ABS", "ABX", "ABY", "IND", "IDX", "IDY", "IMP", "REL", "IZP", "IAX"
+};
+
+static constexpr OpInfoTable buildOpInfo(byte opSet)
+{
+    OpInfoTable table = {};
+    for(int i = 0; i < 0x100; i++)
+        table.ops[i] = OpInfo{0, IMP, 0, 1};
+
+#define OP(code, mnem, addrMode, cyc, handler) \
+    table.ops[code] = OpInfo{#mnem, addrMode, cyc, modeLength(addrMode)};
+#include "opcodes.def"
+    if(opSet == OPS_CMOS)
+    {
+#include "opcodes65c02.def"
+    }
+    else
+    {
+#include "opcodesundoc.def"
+    }
+#undef OP
+
+    return table;
+}
+
+//worked out by the compiler, nothing to set up at run time
+static constexpr OpInfoTable opInfoTables[OP_SETS] = { buildOpInfo(OPS_NMOS), buildOpInfo(OPS_CMOS) };
+
+const OpInfo* getOpInfo(byte opSet)
+{
+    if(opSet >= OP_SETS)
+        opSet = OPS_NMOS;
+    return opInfoTables[opSet].ops;
+}
+
+const char* getModeName(byte mode)
+{
+    if(mode >= ADDR_MODES)
+        return "???";
+    return modeNames[mode];
+}
@@ -0,0 +1,50 @@
+/**************************
+ * HEV6502 CPU Emulator
+ * OPINFO.H
+ * Static per-opcode information built from the opcode tables
+ **************************/
+#ifndef OPINFO_H
+#define OPINFO_H
+
+#define byte unsigned char
+
+//Address modes, same numbering the assembler uses.
+#define IMM 0
+#define ZP  1
+#define ZPX 2
+#define ZPY 3
+#define ABS 4
+#define ABX 5
+#define ABY 6
+#define IND 7
+#define IDX 8
+#define IDY 9
+#define IMP 10
+#define REL 11
+#define IZP 12  //(zp), 65C02 only
+#define IAX 13  //(abs,X), 65C02 JMP only
+#define ADDR_MODES 14
+
+//Opcode sets, one info table each. The CPU's opSet says which it runs.
+#define OPS_NMOS 0  //opcodes.def and opcodesundoc.def, NMOS 6502 and 2A03
+#define OPS_CMOS 1  //opcodes.def changed by opcodes65c02.def
+#define OP_SETS  2
+
+class OpInfo
+{
+public:
+    const char* name;   //mnemonic, 0 if the opcode isn't in the set
+    byte mode;          //address mode
+    byte cycles;        //base cycles, no page crossing or branch penalties
+    byte length;        //bytes with the operand, 1 if the opcode isn't in the set
+};
+
+constexpr byte modeLength(byte mode)
+{
+    return (mode == IMP) ? 1 : (mode == ABS || mode == ABX || mode == ABY || mode == IND || mode == IAX) ? 3 : 2;
+}
+
+const OpInfo* getOpInfo(byte opSet = OPS_NMOS);  //256 entries indexed by opcode
+const char*   getModeName(byte mode);
+
+#endif // OPINFO_H
@@ -0,0 +1,113 @@
+/**************************
+ * HEV6502 CPU Emulator
+ * PACER.CPP
+ * Runs the CPU at a real clock speed against the wall clock
+ **************************/
+#include <cmath>
+#include <iomanip>
+#include <thread>
+#include "pacer.h"
+#include "cpu.h"
+
+using namespace chrono;
+
+Pacer::Pacer(CPU* cpu, double clockHz)
+{
+    this->cpu = cpu;
+    this->clockHz = clockHz;
+    sliceCycles = (int)(clockHz / 1000);
+    if(sliceCycles < 1)
+        sliceCycles = 1; //under 1 kHz, or run() would never get anywhere
+    spinMicros = PACER_SPIN;
+    maxLagMicros = 50000;
+    started = false;
+    reset();
+}
+
+void Pacer::start()
+{
+    anchorTime = steady_clock::now();
+    anchorCycle = cpu->currentClocks;
+    started = true;
+}
+
+void Pacer::reset()
+{
+    slices = 0;
+    overruns = 0;
+    resyncs = 0;
+    jitterSum = 0;
+    jitterSquares = 0;
+    jitterMax = 0;
+    statsTime = steady_clock::now();
+    statsCycle = cpu->currentClocks;
+}
+
+unsigned long long Pacer::run(unsigned long long cycles)
+{
+    if(!started)
+        start();
+    unsigned long long done = 0;
+    while(done < cycles && cpu->PC != 0xFFFF)
+    {
+        unsigned long long left = cycles - done;
+        int most = sliceCycles > 0 ? sliceCycles : 1;
+        int slice = left < (unsigned long long)most ? (int)left : most;
+        done += cpu->run(slice);
+        wait();
+    }
+    return done;
+}
+
+void Pacer::wait()
+{
+    //the deadline is when the CPU's clock should be reached, from the anchor
+    duration<double> emulated((cpu->currentClocks - anchorCycle) / clockHz);
+    steady_clock::time_point deadline = anchorTime + duration_cast<steady_clock::duration>(emulated);
+    steady_clock::time_point now = steady_clock::now();
+    slices++;
+
+    if(now < deadline)
+    {
+        if(deadline - now > microseconds(spinMicros))
+            this_thread::sleep_until(deadline - microseconds(spinMicros));
+        while((now = steady_clock::now()) < deadline)
+            ; //sleeps wake up late by up to a timer tick, spin the tail
+    }
+    else
+        overruns++;
+
+    double late = duration<double, micro>(now - deadline).count();
+    jitterSum += late;
+    jitterSquares += late * late;
+    if(late > jitterMax)
+        jitterMax = late;
+
+    if(late > maxLagMicros)
+    {
+        //paused in a debugger or the host is too slow, catching up would
+        //run flat out for a while
+        resyncs++;
+        start();
+    }
+}
+
+void Pacer::report(ostream& out)
+{
+    double wall = duration<double>(steady_clock::now() - statsTime).count();
+    unsigned long long cycles = cpu->currentClocks - statsCycle;
+    double mean = slices ? jitterSum / slices : 0;
+    double variance = slices ? jitterSquares / slices - mean * mean : 0;
+    double deviation = variance > 0 ? sqrt(variance) : 0;
+
+    out << fixed << setprecision(3);
+    out << "Paced at " << clockHz / 1000000 << " MHz, " << sliceCycles << " cycles a slice" << endl;
+    out << cycles << " cycles in " << wall << " s";
+    if(wall > 0)
+        out << ", " << cycles / wall / 1000000 << " MHz effective";
+    out << endl;
+    out << slices << " slices, " << overruns << " overruns, " << resyncs << " resyncs" << endl;
+    out << setprecision(1);
+    out << "Jitter: mean " << mean << " us, deviation " << deviation << " us, max " << jitterMax << " us" << endl;
+    out.unsetf(ios::floatfield);
+}
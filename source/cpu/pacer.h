@@ -0,0 +1,62 @@
+/**************************
+ * HEV6502 CPU Emulator
+ * PACER.H
+ * Runs the CPU at a real clock speed against the wall clock
+ **************************/
+#ifndef PACER_H
+#define PACER_H
+
+#include <chrono>
+#include <ostream>
+
+#define CLOCK_1MHZ 1000000.0
+#define CLOCK_NTSC 1789773.0    //NES 2A03
+#define CLOCK_PAL  1662607.0
+
+#ifdef _WIN32
+#define PACER_SPIN 2000         //default spin tail in microseconds, sleeps are coarse here
+#else
+#define PACER_SPIN 200
+#endif
+
+using namespace std;
+
+class CPU;
+
+//Runs the CPU in slices of cycles with CPU::run() and waits after each one
+//until the wall clock catches up with the emulated one. The wait sleeps
+//until spinMicros before the deadline and spins the rest. Deadlines are
+//measured from one anchor, so oversleeping one slice is made up in the
+//next instead of adding up.
+class Pacer
+{
+public:
+    Pacer(CPU* cpu, double clockHz);
+    void start();                               //anchor the CPU's clock to now, run() does it the first time
+    unsigned long long run(unsigned long long cycles); //cycles run, fewer if the CPU halts
+    void reset();                               //clears the statistics
+    void report(ostream& out);
+
+    double clockHz;
+    int sliceCycles;        //cycles between waits, 1ms worth by default
+    int spinMicros;         //spin instead of sleeping this close to a deadline
+    int maxLagMicros;       //further behind than this, start() again instead of catching up
+
+    /* Statistics since reset(), times in microseconds */
+    unsigned long long slices;
+    unsigned long long overruns;   //slices the host didn't finish by their deadline
+    unsigned long long resyncs;    //times the pacer gave up catching up
+    double jitterSum;              //how late each slice ended, against its deadline
+    double jitterSquares;
+    double jitterMax;
+private:
+    void wait();
+    CPU* cpu;
+    bool started;
+    chrono::steady_clock::time_point anchorTime;
+    unsigned long long anchorCycle;
+    chrono::steady_clock::time_point statsTime;
+    unsigned long long statsCycle;
+};
+
+#endif // PACER_H
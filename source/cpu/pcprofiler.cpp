@@ -0,0 +1,146 @@
+/**************************
+ * HEV6502 CPU Emulator
+ * PCPROFILER.CPP
+ * Guest PC hot-spot profiler reports
+ **************************/
+#include "pcprofiler.h"
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+#include <string.h>
+
+PCProfiler::PCProfiler(int interval)
+{
+    lineMap = 0;
+    setInterval(interval);
+    reset();
+}
+
+void PCProfiler::reset()
+{
+    memset(pcHits, 0, sizeof(pcHits));
+    totalSamples = 0;
+    countdown = sampleInterval;
+    callStack.clear();
+    stackCounts.clear();
+    stackDirty = true;
+}
+
+void PCProfiler::setInterval(int interval)
+{
+    sampleInterval = (interval > 0) ? interval : 0;
+    countdown = sampleInterval;
+}
+
+void PCProfiler::setSymbols(const map<string, short>& labels)
+{
+    symbols.clear();
+    for(map<string, short>::const_iterator it = labels.begin(); it != labels.end(); ++it)
+        symbols[(unsigned short)it->second] = it->first;
+}
+
+string PCProfiler::symbolFor(unsigned short address)
+{
+    stringstream ss;
+    map<unsigned short, string>::iterator it = symbols.upper_bound(address);
+    if(it == symbols.begin())
+    {
+        ss << "$" << hex << setw(4) << setfill('0') << address;
+        return ss.str();
+    }
+    --it; //closest label at or below the address
+    ss << it->second;
+    if(address != it->first)
+        ss << "+" << (address - it->first);
+    return ss.str();
+}
+
+void PCProfiler::setLineMap(const LineMapReader* lines)
+{
+    lineMap = lines;
+}
+
+static bool hotter(const pair<unsigned long long, unsigned short>& a, const pair<unsigned long long, unsigned short>& b)
+{
+    return a.first > b.first;
+}
+
+void PCProfiler::report(ostream& out, int top)
+{
+    vector<pair<unsigned long long, unsigned short> > hot;
+    for(int i = 0; i < 0x10000; i++)
+    {
+        if(pcHits[i])
+            hot.push_back(make_pair(pcHits[i], (unsigned short)i));
+    }
+    sort(hot.begin(), hot.end(), hotter);
+
+    out << "HEV6502 PC profile, " << totalSamples << " samples";
+    if(sampleInterval)
+        out << " (every " << sampleInterval << " cycles)";
+    out << endl;
+    for(unsigned int i = 0; i < hot.size() && (int)i < top; i++)
+    {
+        double pct = (100.0 * hot[i].first) / totalSamples;
+        out << "$" << hex << setw(4) << setfill('0') << hot[i].second << dec << setfill(' ')
+            << setw(14) << hot[i].first
+            << setw(8) << fixed << setprecision(2) << pct << "  "
+            << symbolFor(hot[i].second);
+        if(lineMap && lineMap->find(hot[i].second))
+            out << "  " << lineMap->location(hot[i].second);
+        out << endl;
+    }
+}
+
+static bool hotterLine(const pair<unsigned long long, const LineMapEntry*>& a, const pair<unsigned long long, const LineMapEntry*>& b)
+{
+    return a.first > b.first;
+}
+
+void PCProfiler::reportLines(ostream& out, int top)
+{
+    if(!lineMap)
+        return;
+    //every byte of a line's code counts, operands can be jumped into
+    map<const LineMapEntry*, unsigned long long> lineHits;
+    unsigned long long unmapped = 0;
+    for(int i = 0; i < 0x10000; i++)
+    {
+        if(!pcHits[i])
+            continue;
+        const LineMapEntry* entry = lineMap->find(i);
+        if(entry)
+            lineHits[entry] += pcHits[i];
+        else
+            unmapped += pcHits[i];
+    }
+    vector<pair<unsigned long long, const LineMapEntry*> > hot;
+    for(map<const LineMapEntry*, unsigned long long>::iterator it = lineHits.begin(); it != lineHits.end(); ++it)
+        hot.push_back(make_pair(it->second, it->first));
+    sort(hot.begin(), hot.end(), hotterLine);
+
+    out << "HEV6502 source line profile, " << totalSamples << " samples, "
+        << unmapped << " outside the line map" << endl;
+    for(unsigned int i = 0; i < hot.size() && (int)i < top; i++)
+    {
+        double pct = (100.0 * hot[i].first) / totalSamples;
+        out << "$" << hex << setw(4) << setfill('0') << hot[i].second->address << dec << setfill(' ')
+            << setw(14) << hot[i].first
+            << setw(8) << fixed << setprecision(2) << pct << "  "
+            << lineMap->location(hot[i].second->address) << endl;
+    }
+}
+
+void PCProfiler::writeFolded(ostream& out)
+{
+    //one line per call stack: root;caller;callee count
+    for(StackMap::iterator it = stackCounts.begin(); it != stackCounts.end(); ++it)
+    {
+        if(!it->second)
+            continue;
+        out << "6502";
+        for(unsigned int i = 0; i < it->first.size(); i++)
+            out << ";" << symbolFor(it->first[i]);
+        out << " " << it->second << endl;
+    }
+}
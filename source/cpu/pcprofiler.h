@@ -0,0 +1,86 @@
+/**************************
+ * HEV6502 CPU Emulator
+ * PCPROFILER.H
+ * Guest PC hot-spot profiler. Only hooked into the CPU when
+ * HEV_PROFILE_PC is defined.
+ **************************/
+#ifndef PCPROFILER_H
+#define PCPROFILER_H
+
+#include <ostream>
+#include <vector>
+#include <map>
+#include <string>
+#include "../trace/linemapreader.h"
+
+#define byte unsigned char
+
+#define OPCODE_JSR 0x20
+#define OPCODE_RTS 0x60
+
+using namespace std;
+
+class PCProfiler
+{
+public:
+    PCProfiler(int interval = 0);   //0 records every instruction, otherwise sample every interval cycles
+    void reset();
+    void setInterval(int interval);
+    void setSymbols(const map<string, short>& labels);  //labels from the assembler
+    string symbolFor(unsigned short address);           //label+offset, or $xxxx
+    void setLineMap(const LineMapReader* lines);        //source lines from the assembler's .map, 0 for none
+    void report(ostream& out, int top = 32);            //hottest addresses first
+    void reportLines(ostream& out, int top = 32);       //hottest source lines first, needs a line map
+    void writeFolded(ostream& out);                     //flamegraph folded stacks
+
+    //called after every instruction with the PC it was fetched from
+    void record(unsigned short pc, byte opCode, int cycles, unsigned short nextPC)
+    {
+        if(!sampleInterval)
+            takeSample(pc);
+        else if((countdown -= cycles) <= 0)
+        {
+            countdown += sampleInterval;
+            takeSample(pc);
+        }
+
+        if(opCode == OPCODE_JSR)
+        {
+            callStack.push_back(nextPC);
+            stackDirty = true;
+        }
+        else if(opCode == OPCODE_RTS && !callStack.empty())
+        {
+            callStack.pop_back();
+            stackDirty = true;
+        }
+    }
+
+    unsigned long long pcHits[0x10000];     //samples per guest address
+    unsigned long long totalSamples;
+private:
+    typedef map<vector<unsigned short>, unsigned long long> StackMap;
+
+    void takeSample(unsigned short pc)
+    {
+        pcHits[pc]++;
+        totalSamples++;
+        if(stackDirty)
+        {
+            currentStack = stackCounts.insert(StackMap::value_type(callStack, 0)).first;
+            stackDirty = false;
+        }
+        currentStack->second++;
+    }
+
+    int sampleInterval;
+    int countdown;
+    vector<unsigned short> callStack;       //entry address of each active subroutine
+    StackMap stackCounts;                   //samples per distinct call stack
+    StackMap::iterator currentStack;
+    bool stackDirty;
+    map<unsigned short, string> symbols;    //address -> label
+    const LineMapReader* lineMap;
+};
+
+#endif // PCPROFILER_H
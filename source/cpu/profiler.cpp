@@ -0,0 +1,110 @@
+/**************************
+ * HEV6502 CPU Emulator
+ * PROFILER.CPP
+ * Per-opcode execution profiler report
+ **************************/
+#include "profiler.h"
+#include <iomanip>
+#include <algorithm>
+#include <vector>
+#include <map>
+#include <string>
+#include <sstream>
+#include <string.h>
+
+class ProfileRow
+{
+public:
+    ProfileRow() : count(0), cycles(0), hostTicks(0) {}
+    string name;
+    unsigned long long count;
+    unsigned long long cycles;
+    double hostTicks;
+    bool operator<(const ProfileRow& other) const { return cycles > other.cycles; }
+};
+
+OpProfiler::OpProfiler()
+{
+    reset();
+}
+
+void OpProfiler::reset()
+{
+    memset(execCount, 0, sizeof(execCount));
+    memset(cycleCount, 0, sizeof(cycleCount));
+    memset(hostTicks, 0, sizeof(hostTicks));
+    memset(hostSamples, 0, sizeof(hostSamples));
+    sampleCountdown = PROFILE_SAMPLE_RATE;
+}
+
+static void printRows(ostream& out, const char* title, vector<ProfileRow>& rows, unsigned long long totalCycles)
+{
+    sort(rows.begin(), rows.end());
+    out << title << endl;
+    out << setw(12) << left << "name" << right
+        << setw(14) << "count" << setw(16) << "cycles" << setw(8) << "%cyc"
+        << setw(16) << "est. ticks" << endl;
+    for(unsigned int i = 0; i < rows.size(); i++)
+    {
+        if(!rows[i].count)
+            continue;
+        double pct = totalCycles ? (100.0 * rows[i].cycles) / totalCycles : 0.0;
+        out << setw(12) << left << rows[i].name << right
+            << setw(14) << rows[i].count << setw(16) << rows[i].cycles
+            << setw(8) << fixed << setprecision(2) << pct
+            << setw(16) << setprecision(0) << rows[i].hostTicks << endl;
+    }
+    out << endl;
+}
+
+void OpProfiler::report(ostream& out, byte opSet)
+{
+    const OpInfo* info = getOpInfo(opSet);
+    vector<ProfileRow> opRows;
+    vector<ProfileRow> modeRows(ADDR_MODES);
+    map<string, ProfileRow> classRows;
+    unsigned long long totalCycles = 0;
+
+    for(int i = 0; i < ADDR_MODES; i++)
+        modeRows[i].name = getModeName(i);
+
+    for(int i = 0; i < 0x100; i++)
+    {
+        if(!execCount[i])
+            continue;
+        //host time is sampled, scale the average back up to every execution
+        double ticks = hostSamples[i] ? ((double)hostTicks[i] / hostSamples[i]) * execCount[i] : 0.0;
+        string mnem = info[i].name ? info[i].name : "???";
+
+        ProfileRow row;
+        stringstream ss;
+        ss << "$" << hex << setw(2) << setfill('0') << uppercase << i << " " << mnem;
+        row.name = ss.str();
+        row.count = execCount[i];
+        row.cycles = cycleCount[i];
+        row.hostTicks = ticks;
+        opRows.push_back(row);
+
+        ProfileRow& mode = modeRows[info[i].mode];
+        mode.count += execCount[i];
+        mode.cycles += cycleCount[i];
+        mode.hostTicks += ticks;
+
+        ProfileRow& cls = classRows[mnem];
+        cls.name = mnem;
+        cls.count += execCount[i];
+        cls.cycles += cycleCount[i];
+        cls.hostTicks += ticks;
+
+        totalCycles += cycleCount[i];
+    }
+
+    vector<ProfileRow> clsRows;
+    for(map<string, ProfileRow>::iterator it = classRows.begin(); it != classRows.end(); ++it)
+        clsRows.push_back(it->second);
+
+    out << "HEV6502 opcode profile, " << totalCycles << " cycles" << endl << endl;
+    printRows(out, "-- by opcode --", opRows, totalCycles);
+    printRows(out, "-- by address mode --", modeRows, totalCycles);
+    printRows(out, "-- by instruction --", clsRows, totalCycles);
+}
@@ -0,0 +1,70 @@
+/**************************
+ * HEV6502 CPU Emulator
+ * PROFILER.H
+ * Per-opcode execution profiler. Only hooked into the CPU when
+ * HEV_PROFILE is defined, otherwise it costs nothing.
+ **************************/
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <ostream>
+#if defined(__i386__) || defined(__x86_64__)
+#include <x86intrin.h>
+#else
+#include <chrono>
+#endif
+
+#define byte unsigned char
+
+#include "opinfo.h"
+
+#define PROFILE_SAMPLE_RATE 64 //time one instruction out of this many on the host
+
+using namespace std;
+
+inline unsigned long long readTimestamp()
+{
+#if defined(__i386__) || defined(__x86_64__)
+    return __rdtsc();
+#else
+    return chrono::duration_cast<chrono::nanoseconds>(
+                chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+class OpProfiler
+{
+public:
+    OpProfiler();
+    void reset();
+    void report(ostream& out, byte opSet = OPS_NMOS); //sorted report, hottest opcodes first. The CPU's opSet names them
+
+    //called around every dispatched opcode
+    unsigned long long begin()
+    {
+        if(--sampleCountdown)
+            return 0;
+        sampleCountdown = PROFILE_SAMPLE_RATE;
+        return readTimestamp();
+    }
+    void end(byte opCode, int cycles, unsigned long long start)
+    {
+        execCount[opCode]++;
+        if(cycles > 0)
+            cycleCount[opCode] += cycles;
+        if(start)
+        {
+            hostTicks[opCode] += readTimestamp() - start;
+            hostSamples[opCode]++;
+        }
+    }
+
+    unsigned long long execCount[256];   //times each opcode ran
+    unsigned long long cycleCount[256];  //emulated cycles spent in each opcode
+    unsigned long long hostTicks[256];   //sampled host ticks
+    unsigned long long hostSamples[256]; //number of samples in hostTicks
+private:
+    unsigned int sampleCountdown;
+};
+
+#endif // PROFILER_H
@@ -0,0 +1,75 @@
+/**************************
+ * HEV6502 CPU Emulator
+ * SCHEDULER.CPP
+ * Device events keyed by emulated cycle
+ **************************/
+#include <algorithm>
+#include "scheduler.h"
+
+//heap order, the earliest event on top
+static bool later(const ScheduledEvent& a, const ScheduledEvent& b)
+{
+    if(a.cycle != b.cycle)
+        return a.cycle > b.cycle;
+    return a.order > b.order;
+}
+
+Scheduler::Scheduler()
+{
+    order = 0;
+    nextId = 1;
+}
+
+int Scheduler::schedule(Device* device, unsigned long long cycle, int tag)
+{
+    ScheduledEvent event;
+    event.cycle = cycle;
+    event.order = order++;
+    event.id = nextId++;
+    event.tag = tag;
+    event.device = device;
+    heap.push_back(event);
+    push_heap(heap.begin(), heap.end(), later);
+    return event.id;
+}
+
+bool Scheduler::cancel(int id)
+{
+    //rare next to schedule() and runDue(), a linear search is fine
+    for(unsigned int i = 0; i < heap.size(); i++)
+    {
+        if(heap[i].id == id)
+        {
+            heap[i] = heap.back();
+            heap.pop_back();
+            make_heap(heap.begin(), heap.end(), later);
+            return true;
+        }
+    }
+    return false;
+}
+
+void Scheduler::clear()
+{
+    heap.clear();
+}
+
+int Scheduler::runDue(unsigned long long now)
+{
+    int fired = 0;
+    while(!heap.empty() && heap[0].cycle <= now)
+    {
+        //off the heap before the call, the device may schedule again
+        pop_heap(heap.begin(), heap.end(), later);
+        ScheduledEvent event = heap.back();
+        heap.pop_back();
+        event.device->event(event.cycle, event.tag);
+        fired++;
+    }
+    return fired;
+}
+
+unsigned int Scheduler::pending() const
+{
+    return heap.size();
+}
@@ -0,0 +1,53 @@
+/**************************
+ * HEV6502 CPU Emulator
+ * SCHEDULER.H
+ * Device events keyed by emulated cycle, fired from CPU::run()
+ **************************/
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <vector>
+
+#define NO_EVENT 0xFFFFFFFFFFFFFFFFULL //nextEvent() with nothing scheduled
+
+using namespace std;
+
+//Timers, video, audio and the like. The scheduler calls event() once the
+//CPU's clock reaches the cycle the device asked for; the CPU may be a few
+//cycles past it, by however long the last instruction took. Schedule the
+//next one from in here.
+class Device
+{
+public:
+    virtual void event(unsigned long long cycle, int tag) = 0;
+};
+
+class ScheduledEvent
+{
+public:
+    unsigned long long cycle;
+    unsigned int order;     //events due on the same cycle fire in the order they were scheduled
+    int id;
+    int tag;                //the device's own, handed back to event()
+    Device* device;
+};
+
+//Min-heap of pending events, so a device costs nothing until it's due
+//instead of being polled every instruction.
+class Scheduler
+{
+public:
+    Scheduler();
+    int  schedule(Device* device, unsigned long long cycle, int tag = 0); //id for cancel()
+    bool cancel(int id);
+    void clear();
+    int  runDue(unsigned long long now); //fires every event due by now, returns how many
+    unsigned int pending() const;
+    unsigned long long nextEvent() const { return heap.empty() ? NO_EVENT : heap[0].cycle; }
+private:
+    vector<ScheduledEvent> heap;
+    unsigned int order;
+    int nextId;
+};
+
+#endif // SCHEDULER_H
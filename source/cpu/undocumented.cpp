@@ -0,0 +1,484 @@
+/**************************
+ * HEV6502 CPU Emulator
+ * UNDOCUMENTED.CPP
+ * Undocumented NMOS opcodes, see opcodesundoc.def
+ **************************/
+#include "cpu.h"
+
+//ASL the memory, then ORA it into A
+void CPU::sloAt(unsigned short address)
+{
+    A = oraOp(modify<&CPU::aslOp>(address));
+}
+
+int CPU::sloz()
+{
+    sloAt(zeroPage());
+    return 5;
+}
+
+int CPU::slozx()
+{
+    sloAt(zeroPageX());
+    return 6;
+}
+
+int CPU::sloix()
+{
+    sloAt(indexedIndirect());
+    return 8;
+}
+
+int CPU::sloiy()
+{
+    sloAt(indirectIndexed());
+    return 8;
+}
+
+int CPU::sloa()
+{
+    sloAt(absolute());
+    return 6;
+}
+
+int CPU::sloax()
+{
+    sloAt(absoluteX());
+    return 7;
+}
+
+int CPU::sloay()
+{
+    sloAt(absoluteY());
+    return 7;
+}
+
+//ROL the memory, then AND it into A
+void CPU::rlaAt(unsigned short address)
+{
+    A = andOp(modify<&CPU::rolOp>(address));
+}
+
+int CPU::rlaz()
+{
+    rlaAt(zeroPage());
+    return 5;
+}
+
+int CPU::rlazx()
+{
+    rlaAt(zeroPageX());
+    return 6;
+}
+
+int CPU::rlaix()
+{
+    rlaAt(indexedIndirect());
+    return 8;
+}
+
+int CPU::rlaiy()
+{
+    rlaAt(indirectIndexed());
+    return 8;
+}
+
+int CPU::rlaa()
+{
+    rlaAt(absolute());
+    return 6;
+}
+
+int CPU::rlaax()
+{
+    rlaAt(absoluteX());
+    return 7;
+}
+
+int CPU::rlaay()
+{
+    rlaAt(absoluteY());
+    return 7;
+}
+
+//LSR the memory, then EOR it into A
+void CPU::sreAt(unsigned short address)
+{
+    A = eorOp(modify<&CPU::lsrOp>(address));
+}
+
+int CPU::srez()
+{
+    sreAt(zeroPage());
+    return 5;
+}
+
+int CPU::srezx()
+{
+    sreAt(zeroPageX());
+    return 6;
+}
+
+int CPU::sreix()
+{
+    sreAt(indexedIndirect());
+    return 8;
+}
+
+int CPU::sreiy()
+{
+    sreAt(indirectIndexed());
+    return 8;
+}
+
+int CPU::srea()
+{
+    sreAt(absolute());
+    return 6;
+}
+
+int CPU::sreax()
+{
+    sreAt(absoluteX());
+    return 7;
+}
+
+int CPU::sreay()
+{
+    sreAt(absoluteY());
+    return 7;
+}
+
+//ROR the memory, then ADC it, carry from the ROR
+void CPU::rraAt(unsigned short address)
+{
+    A = addCOp(modify<&CPU::rorOp>(address));
+}
+
+int CPU::rraz()
+{
+    rraAt(zeroPage());
+    return 5;
+}
+
+int CPU::rrazx()
+{
+    rraAt(zeroPageX());
+    return 6;
+}
+
+int CPU::rraix()
+{
+    rraAt(indexedIndirect());
+    return 8;
+}
+
+int CPU::rraiy()
+{
+    rraAt(indirectIndexed());
+    return 8;
+}
+
+int CPU::rraa()
+{
+    rraAt(absolute());
+    return 6;
+}
+
+int CPU::rraax()
+{
+    rraAt(absoluteX());
+    return 7;
+}
+
+int CPU::rraay()
+{
+    rraAt(absoluteY());
+    return 7;
+}
+
+//DEC the memory, then CMP it
+void CPU::dcpAt(unsigned short address)
+{
+    cmpOp(modify<&CPU::decOp>(address));
+}
+
+int CPU::dcpz()
+{
+    dcpAt(zeroPage());
+    return 5;
+}
+
+int CPU::dcpzx()
+{
+    dcpAt(zeroPageX());
+    return 6;
+}
+
+int CPU::dcpix()
+{
+    dcpAt(indexedIndirect());
+    return 8;
+}
+
+int CPU::dcpiy()
+{
+    dcpAt(indirectIndexed());
+    return 8;
+}
+
+int CPU::dcpa()
+{
+    dcpAt(absolute());
+    return 6;
+}
+
+int CPU::dcpax()
+{
+    dcpAt(absoluteX());
+    return 7;
+}
+
+int CPU::dcpay()
+{
+    dcpAt(absoluteY());
+    return 7;
+}
+
+//INC the memory, then SBC it
+void CPU::iscAt(unsigned short address)
+{
+    A = sbcOp(modify<&CPU::incOp>(address));
+}
+
+int CPU::iscz()
+{
+    iscAt(zeroPage());
+    return 5;
+}
+
+int CPU::isczx()
+{
+    iscAt(zeroPageX());
+    return 6;
+}
+
+int CPU::iscix()
+{
+    iscAt(indexedIndirect());
+    return 8;
+}
+
+int CPU::isciy()
+{
+    iscAt(indirectIndexed());
+    return 8;
+}
+
+int CPU::isca()
+{
+    iscAt(absolute());
+    return 6;
+}
+
+int CPU::iscax()
+{
+    iscAt(absoluteX());
+    return 7;
+}
+
+int CPU::iscay()
+{
+    iscAt(absoluteY());
+    return 7;
+}
+
+//SAX stores A AND X without touching the flags
+int CPU::saxz()
+{
+    writeZeroPage(A & X, zeroPage());
+    return 3;
+}
+
+int CPU::saxzy()
+{
+    writeZeroPage(A & X, zeroPageY());
+    return 4;
+}
+
+int CPU::saxix()
+{
+    cpuMem->writeByte(A & X, indexedIndirect());
+    return 6;
+}
+
+int CPU::saxa()
+{
+    cpuMem->writeByte(A & X, absolute());
+    return 4;
+}
+
+//LAX loads A and X with the same value
+void CPU::laxOp(byte value)
+{
+    A = X = value;
+    signFlag = (A >> 7) & 1;
+    zeroFlag = !A;
+}
+
+int CPU::laxz()
+{
+    laxOp(loadZeroPage(zeroPage()));
+    return 3;
+}
+
+int CPU::laxzy()
+{
+    laxOp(loadZeroPage(zeroPageY()));
+    return 4;
+}
+
+int CPU::laxix()
+{
+    laxOp(cpuMem->loadByte(indexedIndirect()));
+    return 6;
+}
+
+int CPU::laxiy()
+{
+    laxOp(cpuMem->loadByte(indirectIndexed()));
+    return 5;   //could be +1
+}
+
+int CPU::laxa()
+{
+    laxOp(cpuMem->loadByte(absolute()));
+    return 4;
+}
+
+int CPU::laxay()
+{
+    laxOp(cpuMem->loadByte(absoluteY()));
+    return 4;   //could be +1
+}
+
+int CPU::laxi()
+{
+    //unstable, A is ORed with a chip dependent constant first, $EE is common
+    byte in = cpuMem->loadByte(PC);
+    PC++;
+    laxOp((A | 0xEE) & in);
+    return 2;
+}
+
+int CPU::anci()
+{
+    //AND, then C is a copy of N
+    byte in = cpuMem->loadByte(PC);
+    PC++;
+    A = andOp(in);
+    carryFlag = signFlag;
+    return 2;
+}
+
+int CPU::alri()
+{
+    //AND, then LSR A
+    byte in = cpuMem->loadByte(PC);
+    PC++;
+    A = lsrOp(A & in);
+    return 2;
+}
+
+int CPU::arri()
+{
+    //AND, then ROR A, with C and V from bits 6 and 5 of the result
+    byte in = cpuMem->loadByte(PC);
+    PC++;
+    A = rorOp(A & in);
+    carryFlag = (A >> 6) & 1;
+    overFlag = ((A >> 6) ^ (A >> 5)) & 1;
+    return 2;
+}
+
+int CPU::axsi()
+{
+    //X = (A AND X) - value, flags like CMP and no borrow in
+    byte value = cpuMem->loadByte(PC);
+    PC++;
+    byte andX = A & X;
+    carryFlag = (andX >= value) ? 1 : 0;
+    X = andX - value;
+    signFlag = (X >> 7) & 1;
+    zeroFlag = !X;
+    return 2;
+}
+
+int CPU::xaai()
+{
+    //unstable like LAX #, A = (A OR $EE) AND X AND value
+    byte in = cpuMem->loadByte(PC);
+    PC++;
+    A = (A | 0xEE) & X & in;
+    signFlag = (A >> 7) & 1;
+    zeroFlag = !A;
+    return 2;
+}
+
+//SHA, SHX, SHY and TAS store a register ANDed with the high byte of the
+//address before indexing, plus one
+int CPU::shaiy()
+{
+    unsigned short address = indirectIndexed();
+    cpuMem->writeByte(A & X & (((address - Y) >> 8) + 1), address);
+    return 6;
+}
+
+int CPU::shaay()
+{
+    unsigned short address = absoluteY();
+    cpuMem->writeByte(A & X & (((address - Y) >> 8) + 1), address);
+    return 5;
+}
+
+int CPU::shyax()
+{
+    unsigned short address = absoluteX();
+    cpuMem->writeByte(Y & (((address - X) >> 8) + 1), address);
+    return 5;
+}
+
+int CPU::shxay()
+{
+    unsigned short address = absoluteY();
+    cpuMem->writeByte(X & (((address - Y) >> 8) + 1), address);
+    return 5;
+}
+
+int CPU::tasay()
+{
+    unsigned short address = absoluteY();
+    SP = A & X;
+    cpuMem->writeByte(SP & (((address - Y) >> 8) + 1), address);
+    return 5;
+}
+
+int CPU::lasay()
+{
+    //A, X and SP all get memory AND SP
+    A = X = SP = cpuMem->loadByte(absoluteY()) & SP;
+    signFlag = (A >> 7) & 1;
+    zeroFlag = !A;
+    return 4;   //could be +1
+}
+
+int CPU::kil()
+{
+    if(!jamOnKil)
+        return 2; //asked to carry on, PC is already past the opcode
+    //the real chip locks up until it's reset. Stop with PC on the opcode
+    //so execute() and step() return and jammed says why.
+    --PC;
+    jammed = true;
+    return -1;
+}
@@ -0,0 +1,31 @@
+/**************************
+ * HEV6502 CPU Emulator
+ * VARIANTS.H
+ * The 6502 derivatives a CPU can be built as
+ **************************/
+#ifndef VARIANTS_H
+#define VARIANTS_H
+
+//Give one to the CPU's constructor: CPU cpu(&memory, CMOS65C02()).
+//Each has its own CPU::loadJumpTable<>() specialization, so what differs
+//is which handlers the jump table points at and which decimal tables ADC
+//and SBC use, nothing is checked while the CPU runs.
+
+//MOS 6502: the documented opcodes, NMOS decimal flags and the JMP ($xxFF)
+//bug that reads the high byte from $xx00.
+class NMOS6502
+{
+};
+
+//65C02: BRA, STZ, PHX/PHY/PLX/PLY, TSB/TRB, (zp) addressing and the rest,
+//JMP ($xxFF) fixed, N and Z valid in decimal mode, unused opcodes are NOPs.
+class CMOS65C02
+{
+};
+
+//Ricoh 2A03 in the NES: an NMOS 6502 whose D flag does nothing.
+class RP2A03
+{
+};
+
+#endif // VARIANTS_H
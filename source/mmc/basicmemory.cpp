@@ -24,6 +24,14 @@ unsigned short BasicMemory::loadWord(unsigned short address)
     return (unsigned short)((memoryMap[address] << 8) + (memoryMap[++address]));
 }
 
+unsigned short BasicMemory::loadWord16(unsigned short address)
+{
+    //straight from the array without going through loadByte(), $FFFF wraps to $0000
+    if(address == 0xFFFF)
+        return memoryMap[0xFFFF] | (memoryMap[0] << 8);
+    return memoryMap[address] | (memoryMap[address + 1] << 8);
+}
+
 byte  BasicMemory::loadByte(unsigned short address)
 {
     return memoryMap[address];
@@ -47,3 +55,9 @@ unsigned short BasicMemory::getStartAddr()
 {
     return this->programStart;
 }
+
+byte* BasicMemory::getPagePointer(byte page)
+{
+    //it's all RAM
+    return &memoryMap[page << 8];
+}
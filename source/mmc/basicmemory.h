@@ -13,11 +13,13 @@ class BasicMemory : public MemoryController
 public:
     BasicMemory();
     unsigned short loadWord(unsigned short address);
+    unsigned short loadWord16(unsigned short address);
     byte  loadByte(unsigned short address);
     void  writeWord(unsigned short address, unsigned short toWrite);
     void  writeByte(byte toWrite, unsigned short address);
     void  loadProgram(unsigned short address, byte* toLoad, int size);
     unsigned short getStartAddr();
+    byte* getPagePointer(byte page);
     unsigned short lastAddr;
     //void (*memChange)(void);
 private:
@@ -0,0 +1,109 @@
+#ifndef INSTRUMENTEDMEMORY_H
+#define INSTRUMENTEDMEMORY_H
+#include <string>
+
+#include "../cpu/cpu.h"
+#define byte unsigned char
+
+using namespace std;
+
+//Counting policies, picked at compile time so the disabled case costs nothing.
+class CountAccesses
+{
+public:
+    enum { enabled = 1 };
+};
+
+class NoCounting
+{
+public:
+    enum { enabled = 0 };
+};
+
+//Per address access counters, 64K of each.
+class AccessCounters
+{
+public:
+    AccessCounters();
+    void reset();
+    bool writeDump(string fileName);    //raw counters, see memorycounters.cpp for the layout
+    bool writeHeatmap(string fileName); //256x256 PPM, one pixel per address
+    unsigned int reads[0x10000];
+    unsigned int writes[0x10000];
+    unsigned int fetches[0x10000];      //opcode fetches
+};
+
+//Wraps another memory controller and counts every access made through it.
+template<class Policy = CountAccesses>
+class InstrumentedMemory : public MemoryController, public AccessCounters
+{
+public:
+    InstrumentedMemory(MemoryController* memory) : inner(memory) {}
+
+    unsigned short loadWord(unsigned short address)
+    {
+        if(Policy::enabled)
+        {
+            reads[address]++;
+            reads[(unsigned short)(address + 1)]++;
+        }
+        return inner->loadWord(address);
+    }
+    unsigned short loadWord16(unsigned short address)
+    {
+        if(Policy::enabled)
+        {
+            reads[address]++;
+            reads[(unsigned short)(address + 1)]++;
+        }
+        return inner->loadWord16(address);
+    }
+    byte loadByte(unsigned short address)
+    {
+        if(Policy::enabled)
+            reads[address]++;
+        return inner->loadByte(address);
+    }
+    byte fetchByte(unsigned short address)
+    {
+        if(Policy::enabled)
+            fetches[address]++;
+        return inner->fetchByte(address);
+    }
+    byte peekByte(unsigned short address)
+    {
+        return inner->peekByte(address);
+    }
+    void writeWord(unsigned short toStore, unsigned short address)
+    {
+        if(Policy::enabled)
+        {
+            writes[address]++;
+            writes[(unsigned short)(address + 1)]++;
+        }
+        inner->writeWord(toStore, address);
+    }
+    void writeByte(byte toStore, unsigned short address)
+    {
+        if(Policy::enabled)
+            writes[address]++;
+        inner->writeByte(toStore, address);
+    }
+    unsigned short getStartAddr()
+    {
+        return inner->getStartAddr();
+    }
+    void loadProgram(unsigned short startAddress, byte* toLoad, int size)
+    {
+        inner->loadProgram(startAddress, toLoad, size);
+    }
+    byte* getPagePointer(byte page)
+    {
+        //direct access would skip the counters
+        return Policy::enabled ? 0 : inner->getPagePointer(page);
+    }
+private:
+    MemoryController* inner;
+};
+
+#endif // INSTRUMENTEDMEMORY_H
@@ -0,0 +1,86 @@
+#include <fstream>
+#include <math.h>
+#include <string.h>
+#include "instrumentedmemory.h"
+
+/* Dump layout, all little endian:
+ *   "HEVM"                magic
+ *   uint32                version (1)
+ *   uint32 reads[65536]
+ *   uint32 writes[65536]
+ *   uint32 fetches[65536]
+ */
+#define DUMP_VERSION 1
+
+static void putWord32(ofstream& out, unsigned int value)
+{
+    char bytes[4];
+    bytes[0] = value & 0xFF;
+    bytes[1] = (value >> 8) & 0xFF;
+    bytes[2] = (value >> 16) & 0xFF;
+    bytes[3] = (value >> 24) & 0xFF;
+    out.write(bytes, 4);
+}
+
+//log scale so a handful of accesses still shows up next to hot loops
+static byte heat(unsigned int count, double maxLog)
+{
+    if(!count || maxLog <= 0)
+        return 0;
+    return (byte)(64 + (191.0 * log((double)count + 1) / maxLog));
+}
+
+AccessCounters::AccessCounters()
+{
+    reset();
+}
+
+void AccessCounters::reset()
+{
+    memset(reads, 0, sizeof(reads));
+    memset(writes, 0, sizeof(writes));
+    memset(fetches, 0, sizeof(fetches));
+}
+
+bool AccessCounters::writeDump(string fileName)
+{
+    ofstream out(fileName.c_str(), ios::out | ios::binary);
+    if(!out)
+        return false;
+    out.write("HEVM", 4);
+    putWord32(out, DUMP_VERSION);
+    for(int i = 0; i < 0x10000; i++)
+        putWord32(out, reads[i]);
+    for(int i = 0; i < 0x10000; i++)
+        putWord32(out, writes[i]);
+    for(int i = 0; i < 0x10000; i++)
+        putWord32(out, fetches[i]);
+    return out.good();
+}
+
+bool AccessCounters::writeHeatmap(string fileName)
+{
+    //one pixel per address, a row per page. red = writes, green = reads, blue = fetches
+    unsigned int maxCount = 0;
+    for(int i = 0; i < 0x10000; i++)
+    {
+        if(reads[i] > maxCount)   maxCount = reads[i];
+        if(writes[i] > maxCount)  maxCount = writes[i];
+        if(fetches[i] > maxCount) maxCount = fetches[i];
+    }
+    double maxLog = log((double)maxCount + 1);
+
+    ofstream out(fileName.c_str(), ios::out | ios::binary);
+    if(!out)
+        return false;
+    out << "P6\n256 256\n255\n";
+    for(int i = 0; i < 0x10000; i++)
+    {
+        char pixel[3];
+        pixel[0] = heat(writes[i], maxLog);
+        pixel[1] = heat(reads[i], maxLog);
+        pixel[2] = heat(fetches[i], maxLog);
+        out.write(pixel, 3);
+    }
+    return out.good();
+}
@@ -0,0 +1,93 @@
+/**************************
+ * HEV6502 CPU Emulator
+ * LINKTEST.CPP
+ * Links modules that share local label names, exits non-zero on failure
+ **************************/
+#include <iostream>
+#include <string>
+#include <vector>
+#include "../../assembler/linker.h"
+
+static int failures = 0;
+
+static void check(bool ok, const string& what)
+{
+    if(!ok)
+    {
+        cout << "FAIL: " << what << endl;
+        failures++;
+    }
+}
+
+static void printErrors(stack<string>& errors)
+{
+    for(; !errors.empty(); errors.pop())
+        cout << "  " << errors.top() << endl;
+}
+
+int main()
+{
+    //both modules have their own loop:, only start and count are shared
+    vector<SourceFile> sources(2);
+    sources[0].name = "main.s";
+    sources[0].text =
+        ".export start\n"
+        "start: ldx #3\n"
+        "loop:  dex\n"
+        "       bne loop\n"
+        "       jsr count\n"
+        "       brk\n";
+    sources[1].name = "count.s";
+    sources[1].text =
+        ".export count\n"
+        "count: ldy #2\n"
+        "loop:  dey\n"
+        "       bne loop\n"
+        "       rts\n";
+
+    vector<ObjectModule> modules;
+    stack<string> errors;
+    bool assembled = assembleModules(sources, modules, errors, 1);
+    printErrors(errors);
+    check(assembled, "modules assemble");
+    if(!assembled)
+        return 1;
+    check(modules[0].exports.size() == 1 && modules[1].exports.size() == 1, "only .export labels are exported");
+
+    Linker linker;
+    linker.setOffset(0x600);
+    linker.addModule(&modules[0]);
+    linker.addModule(&modules[1]);
+    int size = linker.link();
+    printErrors(*linker.getErrors());
+    check(size == 15, "two modules sharing loop: link");
+    if(size == 15)
+    {
+        byte* code = linker.getBinary();
+        check(code[4] == 0xFD && code[13] == 0xFD, "each bne goes to its own loop");
+        check(code[6] == 0x09 && code[7] == 0x06, "jsr count lands on the second module");
+        map<string, short> labels = linker.getLabels();
+        check(labels.size() == 2 && labels.count("START") && labels.count("COUNT"), "local labels stay out of the link map");
+    }
+
+    //a label another module didn't export can't be reached
+    sources[0].text = "jmp loop\n";
+    assembled = assembleModules(sources, modules, errors, 1);
+    printErrors(errors);
+    check(assembled, "a module importing loop assembles");
+    Linker unresolved;
+    unresolved.addModule(&modules[0]);
+    unresolved.addModule(&modules[1]);
+    check(unresolved.link() == -1, "a module-local label isn't importable");
+
+    //.export of something that isn't there
+    sources[0].text = ".export missing\nrts\n";
+    check(!assembleModules(sources, modules, errors, 1), ".export of an undefined label fails");
+    while(!errors.empty())
+        errors.pop();
+
+    if(failures)
+        return 1;
+    cout << "linktest passed" << endl;
+    return 0;
+}
@@ -0,0 +1,34 @@
+#-------------------------------------------------
+#
+# linktest, links assembler modules and checks the image
+#
+#-------------------------------------------------
+
+QT       -= core gui
+CONFIG   += console c++17 thread
+CONFIG   -= app_bundle
+
+TARGET = linktest
+TEMPLATE = app
+
+
+SOURCES += linktest.cpp \
+    ../../assembler/linker.cpp \
+    ../../assembler/assembler.cpp \
+    ../../assembler/lexer.cpp \
+    ../../assembler/symboltable.cpp \
+    ../../assembler/preprocessor.cpp \
+    ../../assembler/expression.cpp \
+    ../../cpu/opinfo.cpp
+
+HEADERS  += ../../assembler/linker.h \
+    ../../assembler/objectmodule.h \
+    ../../assembler/assembler.h \
+    ../../assembler/lexer.h \
+    ../../assembler/mnemonics.h \
+    ../../assembler/arena.h \
+    ../../assembler/symboltable.h \
+    ../../assembler/preprocessor.h \
+    ../../assembler/expression.h \
+    ../../cpu/opinfo.h \
+    ../../trace/linemap.h
@@ -0,0 +1,180 @@
+/**************************
+ * HEV6502 CPU Emulator
+ * LOCKSTEP.CPP
+ * Differential runner for the CPU class against Ref6502
+ **************************/
+#include <iomanip>
+#include <sstream>
+#include "lockstep.h"
+#include "../../cpu/disassembler.h"
+
+#define STATUS_MASK (0xFF & ~(REF_B | REF_U)) //B and bit 5 aren't real flags
+
+LockstepHarness::LockstepHarness()
+{
+    hev = new CPU(&hevMem);
+    fullCompareInterval = 0;
+    compareCycles = false;
+    historySize = 16;
+    steps = 0;
+}
+
+LockstepHarness::~LockstepHarness()
+{
+    delete hev;
+}
+
+void LockstepHarness::load(unsigned short origin, const byte* code, int size)
+{
+    hevMem.loadProgram(origin, (byte*)code, size);
+    for(int i = 0; i < size; i++)
+        ref.mem[(unsigned short)(origin + i)] = code[i];
+
+    hev->clearRegs();
+    hev->clearFlags();
+    hev->PC = origin;
+    hev->codeBegin = origin;
+    hev->codeEnd = 0xFFFF;
+
+    ref.A = ref.X = ref.Y = 0;
+    ref.SP = 0xFF;
+    ref.P = REF_U;
+    ref.PC = origin;
+    steps = 0;
+    history.clear();
+}
+
+string LockstepHarness::describe(unsigned short pc)
+{
+    byte code[3];
+    for(int i = 0; i < 3; i++)
+        code[i] = ref.mem[(unsigned short)(pc + i)];
+    char text[DISASM_MAX];
+    int length = disassemble(code, pc, text);
+    stringstream ss;
+    ss << hex << uppercase << setfill('0') << setw(4) << pc << ":";
+    for(int i = 0; i < 3; i++)
+    {
+        if(i < length)
+            ss << " " << setw(2) << (int)code[i];
+        else
+            ss << "   ";
+    }
+    ss << "  " << left << setfill(' ') << setw(14) << text << right << setfill('0')
+       << " A:" << setw(2) << (int)ref.A << " X:" << setw(2) << (int)ref.X
+       << " Y:" << setw(2) << (int)ref.Y << " SP:" << setw(2) << (int)ref.SP
+       << " P:" << setw(2) << (int)ref.P;
+    return ss.str();
+}
+
+void LockstepHarness::report(ostream& out, string reason)
+{
+    out << "Divergence after " << steps << " steps: " << reason << endl;
+    out << "Last instructions (reference state before each):" << endl;
+    for(unsigned int i = 0; i < history.size(); i++)
+        out << "  " << history[i] << endl;
+}
+
+bool LockstepHarness::compareMemory(ostream& out, unsigned short address)
+{
+    byte mine = hevMem.loadByte(address);
+    if(mine == ref.mem[address])
+        return true;
+    stringstream ss;
+    ss << hex << uppercase << setfill('0') << "memory $" << setw(4) << address
+       << " HEV=" << setw(2) << (int)mine << " REF=" << setw(2) << (int)ref.mem[address];
+    report(out, ss.str());
+    return false;
+}
+
+bool LockstepHarness::compareState(ostream& out, int hevCycles, int refCycles)
+{
+    stringstream ss;
+    ss << hex << uppercase << setfill('0');
+    byte hevStatus = hev->statusByte() & STATUS_MASK;
+    byte refStatus = ref.P & STATUS_MASK;
+
+    if(hev->PC != ref.PC)
+        ss << " PC HEV=" << setw(4) << hev->PC << " REF=" << setw(4) << ref.PC;
+    if(hev->A != ref.A)
+        ss << " A HEV=" << setw(2) << (int)hev->A << " REF=" << setw(2) << (int)ref.A;
+    if(hev->X != ref.X)
+        ss << " X HEV=" << setw(2) << (int)hev->X << " REF=" << setw(2) << (int)ref.X;
+    if(hev->Y != ref.Y)
+        ss << " Y HEV=" << setw(2) << (int)hev->Y << " REF=" << setw(2) << (int)ref.Y;
+    if(hev->SP != ref.SP)
+        ss << " SP HEV=" << setw(2) << (int)hev->SP << " REF=" << setw(2) << (int)ref.SP;
+    if(hevStatus != refStatus)
+        ss << " P HEV=" << setw(2) << (int)hevStatus << " REF=" << setw(2) << (int)refStatus;
+    if(compareCycles && hevCycles != refCycles)
+        ss << dec << " cycles HEV=" << hevCycles << " REF=" << refCycles;
+
+    if(!ss.str().empty())
+    {
+        report(out, "registers" + ss.str());
+        return false;
+    }
+
+    //whatever either side wrote must match
+    for(int i = 0; i < hevMem.writeCount; i++)
+    {
+        if(!compareMemory(out, hevMem.lastWrite[i]))
+            return false;
+    }
+    for(int i = 0; i < ref.writeCount; i++)
+    {
+        if(!compareMemory(out, ref.lastWrite[i]))
+            return false;
+    }
+
+    if(fullCompareInterval && !(steps % fullCompareInterval))
+    {
+        for(int i = 0; i < 0x10000; i++)
+        {
+            if(!compareMemory(out, i))
+                return false;
+        }
+    }
+    return true;
+}
+
+bool LockstepHarness::run(unsigned long long maxSteps, ostream& out)
+{
+    while(steps < maxSteps)
+    {
+        unsigned short pc = ref.PC;
+        byte opCode = ref.mem[pc];
+
+        history.push_back(describe(pc));
+        if((int)history.size() > historySize)
+            history.pop_front();
+
+        hevMem.writeCount = 0;
+        int hevCycles = hev->step();
+        int refCycles = ref.step();
+        steps++;
+
+        if(refCycles == -1)
+        {
+            out << "Reference model stopped on unknown opcode $" << hex << uppercase
+                << (int)opCode << " at $" << pc << dec << " after " << steps << " steps" << endl;
+            return true;
+        }
+        if(hevCycles == -1)
+        {
+            report(out, "HEV stopped executing");
+            return false;
+        }
+        if(opCode == 0x00)
+        {
+            //ahead of the compare, with no vector HEV halts at $FFFF and the
+            //reference jumps to $0000
+            out << "BRK reached after " << steps << " steps, no divergence" << endl;
+            return true;
+        }
+        if(!compareState(out, hevCycles, refCycles))
+            return false;
+    }
+    out << steps << " steps, no divergence" << endl;
+    return true;
+}
@@ -0,0 +1,75 @@
+/**************************
+ * HEV6502 CPU Emulator
+ * LOCKSTEP.H
+ * Runs the CPU class and the reference model side by side and stops on
+ * the first instruction where their state differs.
+ **************************/
+#ifndef LOCKSTEP_H
+#define LOCKSTEP_H
+
+#include <deque>
+#include <ostream>
+#include <string>
+
+#include "ref6502.h"
+#include "../../mmc/basicmemory.h"
+
+using namespace std;
+
+//BasicMemory that remembers which addresses the last instruction wrote.
+class RecordingMemory : public BasicMemory
+{
+public:
+    RecordingMemory() : writeCount(0) {}
+    void writeByte(byte toWrite, unsigned short address)
+    {
+        log(address);
+        BasicMemory::writeByte(toWrite, address);
+    }
+    void writeWord(unsigned short address, unsigned short toWrite)
+    {
+        log(address);
+        log(address + 1);
+        BasicMemory::writeWord(address, toWrite);
+    }
+    byte* getPagePointer(byte)
+    {
+        //every write has to come through here to be logged
+        return 0;
+    }
+    unsigned short lastWrite[4];
+    int writeCount;
+private:
+    void log(unsigned short address)
+    {
+        if(writeCount < 4)
+            lastWrite[writeCount++] = address;
+    }
+};
+
+class LockstepHarness
+{
+public:
+    LockstepHarness();
+    ~LockstepHarness();
+    void load(unsigned short origin, const byte* code, int size);
+    //true if maxSteps ran (or both cores stopped) without a divergence
+    bool run(unsigned long long maxSteps, ostream& out);
+
+    int  fullCompareInterval;   //compare all 64K every N steps, 0 for never
+    bool compareCycles;         //also require matching cycle counts
+    int  historySize;           //instructions printed before a divergence
+    unsigned long long steps;
+private:
+    bool compareState(ostream& out, int hevCycles, int refCycles);
+    bool compareMemory(ostream& out, unsigned short address);
+    void report(ostream& out, string reason);
+    string describe(unsigned short pc);
+
+    RecordingMemory hevMem;
+    CPU* hev;
+    Ref6502 ref;
+    deque<string> history;
+};
+
+#endif // LOCKSTEP_H
@@ -0,0 +1,49 @@
+#-------------------------------------------------
+#
+# lockstep, runs HEV6502 against a reference 6502
+#
+#-------------------------------------------------
+
+QT       -= core gui
+CONFIG   += console c++17
+CONFIG   -= app_bundle
+
+TARGET = lockstep
+TEMPLATE = app
+
+
+SOURCES += main.cpp \
+    lockstep.cpp \
+    ref6502.cpp \
+    ../../cpu/cpu.cpp \
+    ../../cpu/decimal.cpp \
+    ../../cpu/scheduler.cpp \
+    ../../cpu/cpu65c02.cpp \
+    ../../cpu/undocumented.cpp \
+    ../../cpu/opinfo.cpp \
+    ../../cpu/disassembler.cpp \
+    ../../mmc/basicmemory.cpp \
+    ../../assembler/assembler.cpp \
+    ../../assembler/lexer.cpp \
+    ../../assembler/symboltable.cpp \
+    ../../assembler/preprocessor.cpp \
+    ../../assembler/expression.cpp
+
+HEADERS  += lockstep.h \
+    ref6502.h \
+    ../../cpu/cpu.h \
+    ../../cpu/decimal.h \
+    ../../cpu/scheduler.h \
+    ../../cpu/variants.h \
+    ../../cpu/opinfo.h \
+    ../../cpu/disassembler.h \
+    ../../mmc/basicmemory.h \
+    ../../assembler/assembler.h \
+    ../../assembler/lexer.h \
+    ../../assembler/mnemonics.h \
+    ../../assembler/arena.h \
+    ../../assembler/symboltable.h \
+    ../../assembler/objectmodule.h \
+    ../../assembler/preprocessor.h \
+    ../../assembler/expression.h \
+    ../../trace/linemap.h
@@ -0,0 +1,80 @@
+/**************************
+ * HEV6502 CPU Emulator
+ * MAIN.CPP
+ * lockstep <program> [origin] [max steps] [-cycles] [-full N]
+ * Programs ending in .asm or .s are assembled first, anything else is
+ * loaded as a raw binary at the origin (default $0600).
+ **************************/
+#include <iostream>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+#include <stdlib.h>
+#include "lockstep.h"
+#include "../../assembler/assembler.h"
+
+static bool endsWith(const string& str, const string& suffix)
+{
+    return str.size() >= suffix.size() && str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+int main(int argc, char* argv[])
+{
+    if(argc < 2)
+    {
+        cerr << "usage: lockstep <program> [origin] [max steps] [-cycles] [-full N]" << endl;
+        return 2;
+    }
+
+    LockstepHarness harness;
+    string fileName = argv[1];
+    unsigned short origin = 0x600;
+    unsigned long long maxSteps = 100000000ULL;
+    int positional = 0;
+    for(int i = 2; i < argc; i++)
+    {
+        string arg = argv[i];
+        if(arg == "-cycles")
+            harness.compareCycles = true;
+        else if(arg == "-full" && i + 1 < argc)
+            harness.fullCompareInterval = atoi(argv[++i]);
+        else if(positional++ == 0)
+            origin = (unsigned short)strtoul(argv[i], 0, 16);
+        else
+            maxSteps = strtoull(argv[i], 0, 10);
+    }
+
+    ifstream in(fileName.c_str(), ios::in | ios::binary);
+    if(!in)
+    {
+        cerr << "Couldn't open " << fileName << endl;
+        return 2;
+    }
+    vector<char> data((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+
+    if(endsWith(fileName, ".asm") || endsWith(fileName, ".s"))
+    {
+        Assembler asmber;
+        asmber.setText(string(data.begin(), data.end()));
+        asmber.setOffset(origin);
+        int size = asmber.assemble();
+        if(size == -1)
+        {
+            stack<string>* errors = asmber.getErrors();
+            while(!errors->empty())
+            {
+                cerr << "Asm: " << errors->top() << endl;
+                errors->pop();
+            }
+            return 2;
+        }
+        harness.load(origin, asmber.getBinary(), size);
+    }
+    else
+    {
+        harness.load(origin, (const byte*)data.data(), data.size());
+    }
+
+    return harness.run(maxSteps, cout) ? 0 : 1;
+}
@@ -0,0 +1,445 @@
+/**************************
+ * HEV6502 CPU Emulator
+ * REF6502.CPP
+ * Reference NMOS 6502 model
+ **************************/
+#include <string.h>
+#include "ref6502.h"
+
+Ref6502::Ref6502()
+{
+    memset(mem, 0, sizeof(mem));
+    A = X = Y = 0;
+    SP = 0xFF;
+    P = REF_U;
+    PC = 0;
+    writeCount = 0;
+    pageCrossed = false;
+}
+
+void Ref6502::write(unsigned short addr, byte value)
+{
+    mem[addr] = value;
+    if(writeCount < 4)
+        lastWrite[writeCount++] = addr;
+}
+
+unsigned short Ref6502::fetchWord()
+{
+    unsigned short lo = fetch();
+    return lo | (fetch() << 8);
+}
+
+void Ref6502::push(byte value)
+{
+    write(0x100 + SP, value);
+    SP--;
+}
+
+byte Ref6502::pull()
+{
+    SP++;
+    return read(0x100 + SP);
+}
+
+void Ref6502::setFlag(byte flag, bool on)
+{
+    if(on)
+        P |= flag;
+    else
+        P &= ~flag;
+}
+
+void Ref6502::setNZ(byte value)
+{
+    setFlag(REF_Z, value == 0);
+    setFlag(REF_N, (value & 0x80) != 0);
+}
+
+unsigned short Ref6502::abx()
+{
+    unsigned short base = fetchWord();
+    unsigned short addr = base + X;
+    pageCrossed = (base & 0xFF00) != (addr & 0xFF00);
+    return addr;
+}
+
+unsigned short Ref6502::aby()
+{
+    unsigned short base = fetchWord();
+    unsigned short addr = base + Y;
+    pageCrossed = (base & 0xFF00) != (addr & 0xFF00);
+    return addr;
+}
+
+unsigned short Ref6502::idx()
+{
+    byte ptr = fetch() + X;
+    return read(ptr) | (read((byte)(ptr + 1)) << 8);
+}
+
+unsigned short Ref6502::idy()
+{
+    byte ptr = fetch();
+    unsigned short base = read(ptr) | (read((byte)(ptr + 1)) << 8);
+    unsigned short addr = base + Y;
+    pageCrossed = (base & 0xFF00) != (addr & 0xFF00);
+    return addr;
+}
+
+void Ref6502::adc(byte value)
+{
+    int carry = (P & REF_C) ? 1 : 0;
+    int bin = A + value + carry;
+    if(!(P & REF_D))
+    {
+        setFlag(REF_V, (~(A ^ value) & (A ^ bin) & 0x80) != 0);
+        setFlag(REF_C, bin > 0xFF);
+        A = bin & 0xFF;
+        setNZ(A);
+        return;
+    }
+    //NMOS decimal mode: Z from the binary sum, N and V from the half adjusted one
+    int tmp = (A & 0x0F) + (value & 0x0F) + carry;
+    if(tmp > 9)
+        tmp += 6;
+    if(tmp <= 0x0F)
+        tmp = (tmp & 0x0F) + (A & 0xF0) + (value & 0xF0);
+    else
+        tmp = (tmp & 0x0F) + (A & 0xF0) + (value & 0xF0) + 0x10;
+    setFlag(REF_Z, (bin & 0xFF) == 0);
+    setFlag(REF_N, (tmp & 0x80) != 0);
+    setFlag(REF_V, ((A ^ tmp) & 0x80) && !((A ^ value) & 0x80));
+    if((tmp & 0x1F0) > 0x90)
+        tmp += 0x60;
+    setFlag(REF_C, (tmp & 0xFF0) > 0xF0);
+    A = tmp & 0xFF;
+}
+
+void Ref6502::sbc(byte value)
+{
+    int borrow = (P & REF_C) ? 0 : 1;
+    unsigned int bin = (unsigned int)(A - value - borrow);
+    setFlag(REF_V, ((A ^ bin) & 0x80) && ((A ^ value) & 0x80));
+    setFlag(REF_C, bin < 0x100);
+    if(!(P & REF_D))
+    {
+        A = bin & 0xFF;
+        setNZ(A);
+        return;
+    }
+    //NMOS decimal mode: flags come from the binary difference
+    setNZ(bin & 0xFF);
+    int tmp = (A & 0x0F) - (value & 0x0F) - borrow;
+    if(tmp & 0x10)
+        tmp = ((tmp - 6) & 0x0F) | ((A & 0xF0) - (value & 0xF0) - 0x10);
+    else
+        tmp = (tmp & 0x0F) | ((A & 0xF0) - (value & 0xF0));
+    if(tmp & 0x100)
+        tmp -= 0x60;
+    A = tmp & 0xFF;
+}
+
+void Ref6502::compare(byte reg, byte value)
+{
+    setFlag(REF_C, reg >= value);
+    setNZ((byte)(reg - value));
+}
+
+byte Ref6502::asl(byte value)
+{
+    setFlag(REF_C, (value & 0x80) != 0);
+    value <<= 1;
+    setNZ(value);
+    return value;
+}
+
+byte Ref6502::lsr(byte value)
+{
+    setFlag(REF_C, (value & 0x01) != 0);
+    value >>= 1;
+    setNZ(value);
+    return value;
+}
+
+byte Ref6502::rol(byte value)
+{
+    byte carry = (P & REF_C) ? 1 : 0;
+    setFlag(REF_C, (value & 0x80) != 0);
+    value = (value << 1) | carry;
+    setNZ(value);
+    return value;
+}
+
+byte Ref6502::ror(byte value)
+{
+    byte carry = (P & REF_C) ? 0x80 : 0;
+    setFlag(REF_C, (value & 0x01) != 0);
+    value = (value >> 1) | carry;
+    setNZ(value);
+    return value;
+}
+
+int Ref6502::branch(bool taken)
+{
+    signed char offset = (signed char)fetch();
+    if(!taken)
+        return 2;
+    unsigned short target = PC + offset;
+    int cycles = ((target & 0xFF00) != (PC & 0xFF00)) ? 4 : 3;
+    PC = target;
+    return cycles;
+}
+
+//read-modify-write helpers
+#define RMW(addrExpr, op, cycles) { unsigned short a = addrExpr; write(a, op(read(a))); return cycles; }
+#define LOAD(reg, addrExpr, cycles) { reg = read(addrExpr); setNZ(reg); return cycles + (pageCrossed ? 1 : 0); }
+
+int Ref6502::step()
+{
+    writeCount = 0;
+    pageCrossed = false;
+    byte opCode = fetch();
+    unsigned short addr;
+
+    switch(opCode)
+    {
+    /* ADC */
+    case 0x69: adc(fetch()); return 2;
+    case 0x65: adc(read(zp())); return 3;
+    case 0x75: adc(read(zpx())); return 4;
+    case 0x6D: adc(read(abs())); return 4;
+    case 0x7D: adc(read(abx())); return 4 + pageCrossed;
+    case 0x79: adc(read(aby())); return 4 + pageCrossed;
+    case 0x61: adc(read(idx())); return 6;
+    case 0x71: adc(read(idy())); return 5 + pageCrossed;
+
+    /* AND */
+    case 0x29: A &= fetch(); setNZ(A); return 2;
+    case 0x25: A &= read(zp()); setNZ(A); return 3;
+    case 0x35: A &= read(zpx()); setNZ(A); return 4;
+    case 0x2D: A &= read(abs()); setNZ(A); return 4;
+    case 0x3D: A &= read(abx()); setNZ(A); return 4 + pageCrossed;
+    case 0x39: A &= read(aby()); setNZ(A); return 4 + pageCrossed;
+    case 0x21: A &= read(idx()); setNZ(A); return 6;
+    case 0x31: A &= read(idy()); setNZ(A); return 5 + pageCrossed;
+
+    /* ASL */
+    case 0x0A: A = asl(A); return 2;
+    case 0x06: RMW(zp(), asl, 5)
+    case 0x16: RMW(zpx(), asl, 6)
+    case 0x0E: RMW(abs(), asl, 6)
+    case 0x1E: RMW(abx(), asl, 7)
+
+    /* Branches */
+    case 0x90: return branch(!(P & REF_C));
+    case 0xB0: return branch((P & REF_C) != 0);
+    case 0xF0: return branch((P & REF_Z) != 0);
+    case 0x30: return branch((P & REF_N) != 0);
+    case 0xD0: return branch(!(P & REF_Z));
+    case 0x10: return branch(!(P & REF_N));
+    case 0x50: return branch(!(P & REF_V));
+    case 0x70: return branch((P & REF_V) != 0);
+
+    /* BIT */
+    case 0x24:
+    case 0x2C:
+    {
+        byte value = read(opCode == 0x24 ? zp() : abs());
+        setFlag(REF_Z, (A & value) == 0);
+        setFlag(REF_N, (value & 0x80) != 0);
+        setFlag(REF_V, (value & 0x40) != 0);
+        return opCode == 0x24 ? 3 : 4;
+    }
+
+    /* BRK */
+    case 0x00:
+        PC++;   //BRK skips a padding byte
+        push(PC >> 8);
+        push(PC & 0xFF);
+        push(P | REF_B | REF_U);
+        P |= REF_I;
+        PC = read(0xFFFE) | (read(0xFFFF) << 8);
+        return 7;
+
+    /* Flags */
+    case 0x18: P &= ~REF_C; return 2;
+    case 0xD8: P &= ~REF_D; return 2;
+    case 0x58: P &= ~REF_I; return 2;
+    case 0xB8: P &= ~REF_V; return 2;
+    case 0x38: P |= REF_C; return 2;
+    case 0xF8: P |= REF_D; return 2;
+    case 0x78: P |= REF_I; return 2;
+
+    /* CMP */
+    case 0xC9: compare(A, fetch()); return 2;
+    case 0xC5: compare(A, read(zp())); return 3;
+    case 0xD5: compare(A, read(zpx())); return 4;
+    case 0xCD: compare(A, read(abs())); return 4;
+    case 0xDD: compare(A, read(abx())); return 4 + pageCrossed;
+    case 0xD9: compare(A, read(aby())); return 4 + pageCrossed;
+    case 0xC1: compare(A, read(idx())); return 6;
+    case 0xD1: compare(A, read(idy())); return 5 + pageCrossed;
+
+    /* CPX / CPY */
+    case 0xE0: compare(X, fetch()); return 2;
+    case 0xE4: compare(X, read(zp())); return 3;
+    case 0xEC: compare(X, read(abs())); return 4;
+    case 0xC0: compare(Y, fetch()); return 2;
+    case 0xC4: compare(Y, read(zp())); return 3;
+    case 0xCC: compare(Y, read(abs())); return 4;
+
+    /* DEC */
+    case 0xC6: addr = zp();  write(addr, read(addr) - 1); setNZ(read(addr)); return 5;
+    case 0xD6: addr = zpx(); write(addr, read(addr) - 1); setNZ(read(addr)); return 6;
+    case 0xCE: addr = abs(); write(addr, read(addr) - 1); setNZ(read(addr)); return 6;
+    case 0xDE: addr = abx(); write(addr, read(addr) - 1); setNZ(read(addr)); return 7;
+    case 0xCA: X--; setNZ(X); return 2;
+    case 0x88: Y--; setNZ(Y); return 2;
+
+    /* EOR */
+    case 0x49: A ^= fetch(); setNZ(A); return 2;
+    case 0x45: A ^= read(zp()); setNZ(A); return 3;
+    case 0x55: A ^= read(zpx()); setNZ(A); return 4;
+    case 0x4D: A ^= read(abs()); setNZ(A); return 4;
+    case 0x5D: A ^= read(abx()); setNZ(A); return 4 + pageCrossed;
+    case 0x59: A ^= read(aby()); setNZ(A); return 4 + pageCrossed;
+    case 0x41: A ^= read(idx()); setNZ(A); return 6;
+    case 0x51: A ^= read(idy()); setNZ(A); return 5 + pageCrossed;
+
+    /* INC */
+    case 0xE6: addr = zp();  write(addr, read(addr) + 1); setNZ(read(addr)); return 5;
+    case 0xF6: addr = zpx(); write(addr, read(addr) + 1); setNZ(read(addr)); return 6;
+    case 0xEE: addr = abs(); write(addr, read(addr) + 1); setNZ(read(addr)); return 6;
+    case 0xFE: addr = abx(); write(addr, read(addr) + 1); setNZ(read(addr)); return 7;
+    case 0xE8: X++; setNZ(X); return 2;
+    case 0xC8: Y++; setNZ(Y); return 2;
+
+    /* JMP / JSR */
+    case 0x4C: PC = fetchWord(); return 3;
+    case 0x6C:
+    {
+        //NMOS bug: the pointer's high byte never carries into the next page
+        unsigned short ptr = fetchWord();
+        unsigned short hiAddr = (ptr & 0xFF00) | ((ptr + 1) & 0x00FF);
+        PC = read(ptr) | (read(hiAddr) << 8);
+        return 5;
+    }
+    case 0x20:
+    {
+        unsigned short target = fetchWord();
+        unsigned short ret = PC - 1;
+        push(ret >> 8);
+        push(ret & 0xFF);
+        PC = target;
+        return 6;
+    }
+
+    /* LDA / LDX / LDY */
+    case 0xA9: A = fetch(); setNZ(A); return 2;
+    case 0xA5: LOAD(A, zp(), 3)
+    case 0xB5: LOAD(A, zpx(), 4)
+    case 0xAD: LOAD(A, abs(), 4)
+    case 0xBD: LOAD(A, abx(), 4)
+    case 0xB9: LOAD(A, aby(), 4)
+    case 0xA1: LOAD(A, idx(), 6)
+    case 0xB1: LOAD(A, idy(), 5)
+    case 0xA2: X = fetch(); setNZ(X); return 2;
+    case 0xA6: LOAD(X, zp(), 3)
+    case 0xB6: LOAD(X, zpy(), 4)
+    case 0xAE: LOAD(X, abs(), 4)
+    case 0xBE: LOAD(X, aby(), 4)
+    case 0xA0: Y = fetch(); setNZ(Y); return 2;
+    case 0xA4: LOAD(Y, zp(), 3)
+    case 0xB4: LOAD(Y, zpx(), 4)
+    case 0xAC: LOAD(Y, abs(), 4)
+    case 0xBC: LOAD(Y, abx(), 4)
+
+    /* LSR */
+    case 0x4A: A = lsr(A); return 2;
+    case 0x46: RMW(zp(), lsr, 5)
+    case 0x56: RMW(zpx(), lsr, 6)
+    case 0x4E: RMW(abs(), lsr, 6)
+    case 0x5E: RMW(abx(), lsr, 7)
+
+    /* NOP */
+    case 0xEA: return 2;
+
+    /* ORA */
+    case 0x09: A |= fetch(); setNZ(A); return 2;
+    case 0x05: A |= read(zp()); setNZ(A); return 3;
+    case 0x15: A |= read(zpx()); setNZ(A); return 4;
+    case 0x0D: A |= read(abs()); setNZ(A); return 4;
+    case 0x1D: A |= read(abx()); setNZ(A); return 4 + pageCrossed;
+    case 0x19: A |= read(aby()); setNZ(A); return 4 + pageCrossed;
+    case 0x01: A |= read(idx()); setNZ(A); return 6;
+    case 0x11: A |= read(idy()); setNZ(A); return 5 + pageCrossed;
+
+    /* Stack */
+    case 0x48: push(A); return 3;
+    case 0x08: push(P | REF_B | REF_U); return 3;
+    case 0x68: A = pull(); setNZ(A); return 4;
+    case 0x28: P = (pull() & ~REF_B) | REF_U; return 4;
+
+    /* ROL / ROR */
+    case 0x2A: A = rol(A); return 2;
+    case 0x26: RMW(zp(), rol, 5)
+    case 0x36: RMW(zpx(), rol, 6)
+    case 0x2E: RMW(abs(), rol, 6)
+    case 0x3E: RMW(abx(), rol, 7)
+    case 0x6A: A = ror(A); return 2;
+    case 0x66: RMW(zp(), ror, 5)
+    case 0x76: RMW(zpx(), ror, 6)
+    case 0x6E: RMW(abs(), ror, 6)
+    case 0x7E: RMW(abx(), ror, 7)
+
+    /* RTI / RTS */
+    case 0x40:
+        P = (pull() & ~REF_B) | REF_U;
+        PC = pull();
+        PC |= pull() << 8;
+        return 6;
+    case 0x60:
+        PC = pull();
+        PC |= pull() << 8;
+        PC++;
+        return 6;
+
+    /* SBC */
+    case 0xE9: sbc(fetch()); return 2;
+    case 0xE5: sbc(read(zp())); return 3;
+    case 0xF5: sbc(read(zpx())); return 4;
+    case 0xED: sbc(read(abs())); return 4;
+    case 0xFD: sbc(read(abx())); return 4 + pageCrossed;
+    case 0xF9: sbc(read(aby())); return 4 + pageCrossed;
+    case 0xE1: sbc(read(idx())); return 6;
+    case 0xF1: sbc(read(idy())); return 5 + pageCrossed;
+
+    /* STA / STX / STY */
+    case 0x85: write(zp(), A); return 3;
+    case 0x95: write(zpx(), A); return 4;
+    case 0x8D: write(abs(), A); return 4;
+    case 0x9D: write(abx(), A); return 5;
+    case 0x99: write(aby(), A); return 5;
+    case 0x81: write(idx(), A); return 6;
+    case 0x91: write(idy(), A); return 6;
+    case 0x86: write(zp(), X); return 3;
+    case 0x96: write(zpy(), X); return 4;
+    case 0x8E: write(abs(), X); return 4;
+    case 0x84: write(zp(), Y); return 3;
+    case 0x94: write(zpx(), Y); return 4;
+    case 0x8C: write(abs(), Y); return 4;
+
+    /* Transfers */
+    case 0xAA: X = A; setNZ(X); return 2;
+    case 0xA8: Y = A; setNZ(Y); return 2;
+    case 0xBA: X = SP; setNZ(X); return 2;
+    case 0x8A: A = X; setNZ(A); return 2;
+    case 0x9A: SP = X; return 2;
+    case 0x98: A = Y; setNZ(A); return 2;
+
+    default:
+        PC--;   //leave PC on the opcode we didn't know
+        return -1;
+    }
+}
@@ -0,0 +1,70 @@
+/**************************
+ * HEV6502 CPU Emulator
+ * REF6502.H
+ * Independent reference model of the NMOS 6502, used to check the CPU
+ * class instruction by instruction. Written for clarity, not speed, and
+ * shares no code with cpu.cpp on purpose.
+ **************************/
+#ifndef REF6502_H
+#define REF6502_H
+
+#define byte unsigned char
+
+#define REF_C 0x01
+#define REF_Z 0x02
+#define REF_I 0x04
+#define REF_D 0x08
+#define REF_B 0x10
+#define REF_U 0x20
+#define REF_V 0x40
+#define REF_N 0x80
+
+class Ref6502
+{
+public:
+    Ref6502();
+    int step();         //cycles used, -1 on an opcode the reference doesn't know
+
+    byte A;
+    byte X;
+    byte Y;
+    byte SP;
+    byte P;
+    unsigned short PC;
+    byte mem[0x10000];
+
+    unsigned short lastWrite[4];    //addresses written by the last step
+    int writeCount;
+private:
+    byte read(unsigned short addr) { return mem[addr]; }
+    void write(unsigned short addr, byte value);
+    byte fetch() { return mem[PC++]; }
+    unsigned short fetchWord();
+    void push(byte value);
+    byte pull();
+    void setNZ(byte value);
+    void setFlag(byte flag, bool on);
+
+    //address modes, return the effective address
+    unsigned short zp()  { return fetch(); }
+    unsigned short zpx() { return (byte)(fetch() + X); }
+    unsigned short zpy() { return (byte)(fetch() + Y); }
+    unsigned short abs() { return fetchWord(); }
+    unsigned short abx();
+    unsigned short aby();
+    unsigned short idx();
+    unsigned short idy();
+
+    void adc(byte value);
+    void sbc(byte value);
+    void compare(byte reg, byte value);
+    byte asl(byte value);
+    byte lsr(byte value);
+    byte rol(byte value);
+    byte ror(byte value);
+    int  branch(bool taken);
+
+    bool pageCrossed;
+};
+
+#endif // REF6502_H
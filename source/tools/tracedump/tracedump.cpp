@@ -0,0 +1,85 @@
+/**************************
+ * HEV6502 CPU Emulator
+ * TRACEDUMP.CPP
+ * Prints a binary trace written by TraceWriter as disassembly
+ **************************/
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <stdlib.h>
+#include "../../trace/tracereader.h"
+#include "../../trace/linemapreader.h"
+#include "../../cpu/disassembler.h"
+
+int main(int argc, char* argv[])
+{
+    //-m names the assembler's .map, records then end with their source line
+    LineMapReader lines;
+    bool mapped = false;
+    if(argc > 2 && string(argv[1]) == "-m")
+    {
+        if(!lines.open(argv[2]))
+        {
+            cerr << lines.error << endl;
+            return 1;
+        }
+        mapped = true;
+        argc -= 2;
+        argv += 2;
+    }
+    if(argc < 2)
+    {
+        cerr << "usage: tracedump [-m line map] <trace file> [max records]" << endl;
+        return 1;
+    }
+    unsigned long long limit = (argc > 2) ? strtoull(argv[2], 0, 10) : 0;
+
+    TraceReader reader;
+    if(!reader.open(argv[1]))
+    {
+        cerr << reader.error << endl;
+        return 1;
+    }
+
+    TraceRecord rec;
+    unsigned long long count = 0;
+    byte opSet = reader.cmos ? OPS_CMOS : OPS_NMOS;
+    cout << hex << uppercase << setfill('0');
+    while((!limit || count < limit) && reader.next(rec))
+    {
+        const OpInfo& info = getOpInfo(opSet)[rec.opCode];
+        byte code[3] = { rec.opCode, rec.operand[0], rec.operand[1] };
+        char text[DISASM_MAX];
+        int length = disassemble(code, rec.pc, text, opSet) - 1;
+
+        cout << dec << setfill(' ') << setw(12) << reader.cycle() << hex << setfill('0')
+             << "  " << setw(4) << rec.pc << "  " << setw(2) << (int)rec.opCode;
+        for(int i = 0; i < 2; i++)
+        {
+            if(i < length)
+                cout << " " << setw(2) << (int)rec.operand[i];
+            else
+                cout << "   ";
+        }
+        cout << "  " << left << setfill(' ') << setw(14) << text << right << setfill('0')
+             << " A:" << setw(2) << (int)rec.A << " X:" << setw(2) << (int)rec.X
+             << " Y:" << setw(2) << (int)rec.Y << " SP:" << setw(2) << (int)rec.SP
+             << " P:" << setw(2) << (int)rec.P;
+        if(info.name && info.mode != IMP)
+            cout << " EA:" << setw(4) << rec.address;
+        if(mapped)
+        {
+            string location = lines.location(rec.pc);
+            if(!location.empty())
+                cout << "  ; " << location;
+        }
+        cout << endl;
+        count++;
+    }
+    if(!reader.error.empty())
+    {
+        cerr << reader.error << endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,28 @@
+#-------------------------------------------------
+#
+# tracedump, prints HEV6502 binary traces
+#
+#-------------------------------------------------
+
+QT       -= core gui
+CONFIG   += console c++17
+CONFIG   -= app_bundle
+
+TARGET = tracedump
+TEMPLATE = app
+
+
+SOURCES += tracedump.cpp \
+    ../../trace/tracereader.cpp \
+    ../../trace/linemapreader.cpp \
+    ../../trace/lz.cpp \
+    ../../cpu/opinfo.cpp \
+    ../../cpu/disassembler.cpp
+
+HEADERS  += ../../trace/tracereader.h \
+    ../../trace/linemapreader.h \
+    ../../trace/linemap.h \
+    ../../trace/tracerecord.h \
+    ../../trace/lz.h \
+    ../../cpu/opinfo.h \
+    ../../cpu/disassembler.h
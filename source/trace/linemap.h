@@ -0,0 +1,31 @@
+/**************************
+ * HEV6502 CPU Emulator
+ * LINEMAP.H
+ * Address to source line map written by the assembler
+ **************************/
+#ifndef LINEMAP_H
+#define LINEMAP_H
+
+/* Line map layout, little endian, read in place so it can be mapped:
+ *   "HEVL"          magic
+ *   uint32          version
+ *   uint32          entry count
+ *   uint32          file count
+ *   uint32          offset of the file name table
+ *   LineMapEntry[]  one per line that produced code, sorted by address
+ *   file names      0 terminated, the first is "" for the assembled text itself
+ */
+#define LINEMAP_VERSION 1
+#define LINEMAP_HEADER  20
+
+class LineMapEntry
+{
+public:
+    unsigned int   line;        //1 based line in its file
+    unsigned short address;     //first byte of the line's code
+    unsigned short size;        //bytes of code, never 0
+    unsigned short file;        //index into the file name table
+    unsigned short pad;
+};
+
+#endif // LINEMAP_H
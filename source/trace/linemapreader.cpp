@@ -0,0 +1,180 @@
+/**************************
+ * HEV6502 CPU Emulator
+ * LINEMAPREADER.CPP
+ * Maps a line map written by Assembler::outputToFile()
+ **************************/
+#include <string.h>
+#include <sstream>
+#include "linemapreader.h"
+
+#ifdef _WIN32
+#include <fstream>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+static_assert(sizeof(LineMapEntry) == 12, "line map entries must stay 12 bytes");
+
+static unsigned int getWord32(const byte* bytes)
+{
+    return bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | ((unsigned int)bytes[3] << 24);
+}
+
+LineMapReader::LineMapReader()
+{
+    data = 0;
+    size = 0;
+    entries = 0;
+    entryCount = 0;
+}
+
+LineMapReader::~LineMapReader()
+{
+    close();
+}
+
+void LineMapReader::close()
+{
+#ifdef _WIN32
+    buffer.clear();
+#else
+    if(data)
+        munmap((void*)data, size);
+#endif
+    data = 0;
+    size = 0;
+    entries = 0;
+    entryCount = 0;
+    files.clear();
+}
+
+bool LineMapReader::open(string fileName)
+{
+    close();
+#ifdef _WIN32
+    ifstream in(fileName.c_str(), ios::in | ios::binary);
+    if(!in)
+    {
+        error = "Couldn't open " + fileName;
+        return false;
+    }
+    buffer.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+    data = buffer.data();
+    size = buffer.size();
+#else
+    int fd = ::open(fileName.c_str(), O_RDONLY);
+    if(fd < 0)
+    {
+        error = "Couldn't open " + fileName;
+        return false;
+    }
+    struct stat info;
+    if(fstat(fd, &info) == 0 && info.st_size >= LINEMAP_HEADER)
+    {
+        void* mapped = mmap(0, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(mapped != MAP_FAILED)
+        {
+            data = (const byte*)mapped;
+            size = info.st_size;
+        }
+    }
+    ::close(fd);
+#endif
+
+    if(size < LINEMAP_HEADER || memcmp(data, "HEVL", 4))
+    {
+        close();
+        error = fileName + " is not a line map";
+        return false;
+    }
+    if(getWord32(data + 4) != LINEMAP_VERSION)
+    {
+        close();
+        error = "Unsupported line map version";
+        return false;
+    }
+    unsigned int count = getWord32(data + 8);
+    unsigned int fileCount = getWord32(data + 12);
+    unsigned int names = getWord32(data + 16);
+    if(count > (size - LINEMAP_HEADER) / sizeof(LineMapEntry) || names < LINEMAP_HEADER + count * sizeof(LineMapEntry) || names > size)
+    {
+        close();
+        error = fileName + " is damaged";
+        return false;
+    }
+    entries = (const LineMapEntry*)(data + LINEMAP_HEADER);
+    entryCount = count;
+
+    //names are only checked once here, lookups trust them
+    const char* name = (const char*)data + names;
+    const char* end = (const char*)data + size;
+    for(unsigned int i = 0; i < fileCount; i++)
+    {
+        const char* zero = (const char*)memchr(name, 0, end - name);
+        if(!zero)
+        {
+            close();
+            error = fileName + " is damaged";
+            return false;
+        }
+        files.push_back(name);
+        name = zero + 1;
+    }
+    for(unsigned int i = 0; i < entryCount; i++)
+    {
+        if(entries[i].file >= files.size())
+        {
+            close();
+            error = fileName + " is damaged";
+            return false;
+        }
+    }
+    return true;
+}
+
+const LineMapEntry* LineMapReader::find(unsigned short address) const
+{
+    //last entry starting at or below the address
+    unsigned int lo = 0;
+    unsigned int hi = entryCount;
+    while(lo < hi)
+    {
+        unsigned int mid = (lo + hi) / 2;
+        if(entries[mid].address <= address)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if(lo == 0)
+        return 0;
+    const LineMapEntry* entry = &entries[lo - 1];
+    if(address - entry->address >= entry->size)
+        return 0;
+    return entry;
+}
+
+const char* LineMapReader::fileName(const LineMapEntry* entry) const
+{
+    return files[entry->file];
+}
+
+string LineMapReader::location(unsigned short address) const
+{
+    const LineMapEntry* entry = find(address);
+    if(!entry)
+        return "";
+    stringstream ss;
+    if(*fileName(entry))
+        ss << fileName(entry) << " line " << entry->line;
+    else
+        ss << "Line " << entry->line;
+    return ss.str();
+}
+
+unsigned int LineMapReader::count() const
+{
+    return entryCount;
+}
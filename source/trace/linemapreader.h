@@ -0,0 +1,42 @@
+/**************************
+ * HEV6502 CPU Emulator
+ * LINEMAPREADER.H
+ * Maps a line map written by Assembler::outputToFile() and looks up
+ * the source line behind an address
+ **************************/
+#ifndef LINEMAPREADER_H
+#define LINEMAPREADER_H
+
+#include <string>
+#include <vector>
+
+#include "linemap.h"
+
+#define byte unsigned char
+
+using namespace std;
+
+class LineMapReader
+{
+public:
+    LineMapReader();
+    ~LineMapReader();
+    bool open(string fileName);
+    void close();
+    const LineMapEntry* find(unsigned short address) const;    //line whose code covers address, or 0
+    const char* fileName(const LineMapEntry* entry) const;      //"" for the assembled text itself
+    string location(unsigned short address) const;             //"Line N", "file line N" or "" if unknown
+    unsigned int count() const;
+    string error;                   //set when open() fails
+private:
+    const byte* data;
+    size_t size;
+    const LineMapEntry* entries;
+    unsigned int entryCount;
+    vector<const char*> files;
+#ifdef _WIN32
+    vector<byte> buffer;            //no mmap, the file is read in
+#endif
+};
+
+#endif // LINEMAPREADER_H
@@ -0,0 +1,168 @@
+/**************************
+ * HEV6502 CPU Emulator
+ * LZ.CPP
+ * LZ4 block format: token, literals, 16 bit offset, match length.
+ * Greedy single probe hash, good enough for repetitive trace data.
+ **************************/
+#include <string.h>
+#include "lz.h"
+
+#define LZ_MINMATCH     4
+#define LZ_LASTLITERALS 5   //last bytes are always literals
+#define LZ_MFLIMIT      12  //no match may start this close to the end
+#define LZ_MAXOFFSET    0xFFFF
+#define LZ_HASHBITS     12
+
+static unsigned int read32(const byte* ptr)
+{
+    unsigned int value;
+    memcpy(&value, ptr, 4);
+    return value;
+}
+
+static unsigned int hash32(unsigned int value)
+{
+    return (value * 2654435761U) >> (32 - LZ_HASHBITS);
+}
+
+static byte* writeLength(byte* out, int length)
+{
+    while(length >= 255)
+    {
+        *out++ = 255;
+        length -= 255;
+    }
+    *out++ = (byte)length;
+    return out;
+}
+
+int lzBound(int srcSize)
+{
+    return srcSize + (srcSize / 255) + 16;
+}
+
+int lzCompress(const byte* src, int srcSize, byte* dst, int dstCapacity)
+{
+    int table[1 << LZ_HASHBITS];
+    byte* out = dst;
+    byte* outEnd = dst + dstCapacity;
+    int ip = 0;
+    int anchor = 0;
+
+    for(int i = 0; i < (1 << LZ_HASHBITS); i++)
+        table[i] = -1;
+
+    while(srcSize > LZ_MFLIMIT && ip < srcSize - LZ_MFLIMIT)
+    {
+        unsigned int seq = read32(src + ip);
+        unsigned int h = hash32(seq);
+        int ref = table[h];
+        table[h] = ip;
+        if(ref < 0 || ip - ref > LZ_MAXOFFSET || read32(src + ref) != seq)
+        {
+            ip++;
+            continue;
+        }
+
+        int matchLen = LZ_MINMATCH;
+        while(ip + matchLen < srcSize - LZ_LASTLITERALS && src[ref + matchLen] == src[ip + matchLen])
+            matchLen++;
+
+        int litLen = ip - anchor;
+        if(outEnd - out < 1 + litLen / 255 + 1 + litLen + 2 + matchLen / 255 + 1)
+            return -1;
+
+        byte* token = out++;
+        *token = (byte)(((litLen < 15) ? litLen : 15) << 4);
+        if(litLen >= 15)
+            out = writeLength(out, litLen - 15);
+        memcpy(out, src + anchor, litLen);
+        out += litLen;
+
+        int offset = ip - ref;
+        *out++ = offset & 0xFF;
+        *out++ = (offset >> 8) & 0xFF;
+
+        int extra = matchLen - LZ_MINMATCH;
+        *token |= (byte)((extra < 15) ? extra : 15);
+        if(extra >= 15)
+            out = writeLength(out, extra - 15);
+
+        ip += matchLen;
+        anchor = ip;
+    }
+
+    //trailing literals
+    int litLen = srcSize - anchor;
+    if(outEnd - out < 1 + litLen / 255 + 1 + litLen)
+        return -1;
+    *out++ = (byte)(((litLen < 15) ? litLen : 15) << 4);
+    if(litLen >= 15)
+        out = writeLength(out, litLen - 15);
+    memcpy(out, src + anchor, litLen);
+    out += litLen;
+    return out - dst;
+}
+
+int lzDecompress(const byte* src, int srcSize, byte* dst, int dstCapacity)
+{
+    const byte* in = src;
+    const byte* inEnd = src + srcSize;
+    byte* out = dst;
+    byte* outEnd = dst + dstCapacity;
+
+    while(in < inEnd)
+    {
+        byte token = *in++;
+
+        int litLen = token >> 4;
+        if(litLen == 15)
+        {
+            byte more;
+            do
+            {
+                if(in >= inEnd)
+                    return -1;
+                more = *in++;
+                litLen += more;
+            } while(more == 255);
+        }
+        if(inEnd - in < litLen || outEnd - out < litLen)
+            return -1;
+        memcpy(out, in, litLen);
+        in += litLen;
+        out += litLen;
+
+        if(in == inEnd)
+            break;  //last sequence has no match
+
+        if(inEnd - in < 2)
+            return -1;
+        int offset = in[0] | (in[1] << 8);
+        in += 2;
+        if(!offset || offset > out - dst)
+            return -1;
+
+        int matchLen = token & 0xF;
+        if(matchLen == 15)
+        {
+            byte more;
+            do
+            {
+                if(in >= inEnd)
+                    return -1;
+                more = *in++;
+                matchLen += more;
+            } while(more == 255);
+        }
+        matchLen += LZ_MINMATCH;
+        if(outEnd - out < matchLen)
+            return -1;
+
+        //byte at a time, matches may overlap their own output
+        const byte* match = out - offset;
+        for(int i = 0; i < matchLen; i++)
+            *out++ = *match++;
+    }
+    return out - dst;
+}
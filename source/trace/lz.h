@@ -0,0 +1,16 @@
+/**************************
+ * HEV6502 CPU Emulator
+ * LZ.H
+ * Small LZ4 block format compressor for trace chunks
+ **************************/
+#ifndef LZ_H
+#define LZ_H
+
+#define byte unsigned char
+
+int lzBound(int srcSize);   //worst case output size
+//Both return the number of bytes written to dst, or -1 if it didn't fit / the input is bad.
+int lzCompress(const byte* src, int srcSize, byte* dst, int dstCapacity);
+int lzDecompress(const byte* src, int srcSize, byte* dst, int dstCapacity);
+
+#endif // LZ_H
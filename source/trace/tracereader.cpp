@@ -0,0 +1,116 @@
+/**************************
+ * HEV6502 CPU Emulator
+ * TRACEREADER.CPP
+ * Reads back files written by TraceWriter
+ **************************/
+#include <string.h>
+#include "tracereader.h"
+#include "lz.h"
+
+static bool getWord32(ifstream& in, unsigned int& value)
+{
+    byte bytes[4];
+    if(!in.read((char*)bytes, 4))
+        return false;
+    value = bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | ((unsigned int)bytes[3] << 24);
+    return true;
+}
+
+TraceReader::TraceReader()
+{
+    compressed = false;
+    cmos = false;
+    pos = 0;
+    cycleHigh = 0;
+    lastCycle = 0;
+}
+
+bool TraceReader::open(string fileName)
+{
+    char magic[4];
+    unsigned int version = 0;
+    unsigned int flags = 0;
+
+    in.open(fileName.c_str(), ios::in | ios::binary);
+    if(!in)
+    {
+        error = "Couldn't open " + fileName;
+        return false;
+    }
+    if(!in.read(magic, 4) || memcmp(magic, "HEVT", 4) || !getWord32(in, version) || !getWord32(in, flags))
+    {
+        error = fileName + " is not a trace file";
+        return false;
+    }
+    if(version != TRACE_VERSION)
+    {
+        error = "Unsupported trace version";
+        return false;
+    }
+    compressed = (flags & TRACE_FLAG_COMPRESSED) != 0;
+    cmos = (flags & TRACE_FLAG_65C02) != 0;
+    records.clear();
+    pos = 0;
+    cycleHigh = 0;
+    lastCycle = 0;
+    return true;
+}
+
+bool TraceReader::loadChunk()
+{
+    unsigned int rawSize = 0;
+    unsigned int storedSize = 0;
+    if(!getWord32(in, rawSize) || !getWord32(in, storedSize))
+        return false; //clean end of file
+
+    if(rawSize % sizeof(TraceRecord) || storedSize > rawSize)
+    {
+        error = "Corrupt chunk header";
+        return false;
+    }
+    records.resize(rawSize);
+    pos = 0;
+    if(storedSize == rawSize)
+    {
+        if(!in.read((char*)records.data(), rawSize))
+        {
+            error = "Truncated chunk";
+            return false;
+        }
+        return true;
+    }
+
+    packed.resize(storedSize);
+    if(!in.read((char*)packed.data(), storedSize))
+    {
+        error = "Truncated chunk";
+        return false;
+    }
+    if(lzDecompress(packed.data(), storedSize, records.data(), rawSize) != (int)rawSize)
+    {
+        error = "Corrupt compressed chunk";
+        return false;
+    }
+    return true;
+}
+
+bool TraceReader::next(TraceRecord& rec)
+{
+    while(pos >= records.size())
+    {
+        if(!loadChunk())
+            return false;
+    }
+    memcpy(&rec, records.data() + pos, sizeof(TraceRecord));
+    pos += sizeof(TraceRecord);
+
+    if(rec.cycle < lastCycle)
+        cycleHigh += 0x100000000ULL;
+    lastCycle = rec.cycle;
+    return true;
+}
+
+unsigned long long TraceReader::cycle()
+{
+    return cycleHigh + lastCycle;
+}
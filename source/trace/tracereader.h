@@ -0,0 +1,38 @@
+/**************************
+ * HEV6502 CPU Emulator
+ * TRACEREADER.H
+ * Reads back files written by TraceWriter
+ **************************/
+#ifndef TRACEREADER_H
+#define TRACEREADER_H
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "tracerecord.h"
+
+using namespace std;
+
+class TraceReader
+{
+public:
+    TraceReader();
+    bool open(string fileName);
+    bool next(TraceRecord& rec);    //false at the end of the trace or on error
+    unsigned long long cycle();     //full cycle count of the last record read
+    bool cmos;                      //written by a 65C02, TRACE_FLAG_65C02
+    string error;                   //set when open() or next() fail on a bad file
+private:
+    bool loadChunk();
+
+    ifstream in;
+    bool compressed;
+    vector<byte> records;
+    vector<byte> packed;
+    unsigned int pos;
+    unsigned long long cycleHigh;   //records only keep 32 bits, count the wraps
+    unsigned int lastCycle;
+};
+
+#endif // TRACEREADER_H
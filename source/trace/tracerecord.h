@@ -0,0 +1,39 @@
+/**************************
+ * HEV6502 CPU Emulator
+ * TRACERECORD.H
+ * Fixed size binary trace record and file layout
+ **************************/
+#ifndef TRACERECORD_H
+#define TRACERECORD_H
+
+#define byte unsigned char
+
+/* Trace file layout, little endian:
+ *   "HEVT"          magic
+ *   uint32          version
+ *   uint32          flags (TRACE_FLAG_*)
+ *   chunks:
+ *     uint32        raw size in bytes, a multiple of sizeof(TraceRecord)
+ *     uint32        stored size, equal to the raw size if the chunk isn't compressed
+ *     byte[stored]  records, LZ4 block compressed when stored < raw
+ */
+#define TRACE_VERSION         1
+#define TRACE_FLAG_COMPRESSED 1
+#define TRACE_FLAG_65C02      2    //disassemble with the 65C02's opcodes
+
+class TraceRecord
+{
+public:
+    unsigned int   cycle;       //low 32 bits of the cycle count the instruction started on
+    unsigned short pc;
+    unsigned short address;     //effective address, 0 for implied/accumulator
+    byte opCode;
+    byte operand[2];            //bytes following the opcode, for disassembly
+    byte A;
+    byte X;
+    byte Y;
+    byte SP;
+    byte P;                     //status register before the instruction
+};
+
+#endif // TRACERECORD_H
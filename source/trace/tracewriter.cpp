@@ -0,0 +1,207 @@
+/**************************
+ * HEV6502 CPU Emulator
+ * TRACEWRITER.CPP
+ * Binary instruction trace sink
+ **************************/
+#include <chrono>
+#include "tracewriter.h"
+#include "lz.h"
+#include "../cpu/opinfo.h"
+
+static_assert(sizeof(TraceRecord) == 16, "trace records must stay 16 bytes");
+
+#define TRACE_BLOCK_BYTES (TRACE_BLOCK_RECORDS * (int)sizeof(TraceRecord))
+
+static void putWord32(ofstream& out, unsigned int value)
+{
+    char bytes[4];
+    bytes[0] = value & 0xFF;
+    bytes[1] = (value >> 8) & 0xFF;
+    bytes[2] = (value >> 16) & 0xFF;
+    bytes[3] = (value >> 24) & 0xFF;
+    out.write(bytes, 4);
+}
+
+TraceWriter::TraceWriter() : published(0), consumed(0), stopping(false)
+{
+    for(int i = 0; i < TRACE_BLOCKS; i++)
+        blocks[i] = new TraceRecord[TRACE_BLOCK_RECORDS];
+    packBuffer = new byte[lzBound(TRACE_BLOCK_BYTES)];
+    fill = 0;
+    produced = 0;
+    recordCount = 0;
+    compressed = false;
+}
+
+TraceWriter::~TraceWriter()
+{
+    close();
+    for(int i = 0; i < TRACE_BLOCKS; i++)
+        delete[] blocks[i];
+    delete[] packBuffer;
+}
+
+bool TraceWriter::open(string fileName, bool compress, byte opSet)
+{
+    close();
+    out.open(fileName.c_str(), ios::out | ios::binary | ios::trunc);
+    if(!out)
+        return false;
+    compressed = compress;
+    out.write("HEVT", 4);
+    putWord32(out, TRACE_VERSION);
+    putWord32(out, (compressed ? TRACE_FLAG_COMPRESSED : 0) | (opSet == OPS_CMOS ? TRACE_FLAG_65C02 : 0));
+
+    fill = 0;
+    produced = 0;
+    published = 0;
+    consumed = 0;
+    stopping = false;
+    flusher = thread(&TraceWriter::flushLoop, this);
+    return true;
+}
+
+void TraceWriter::close()
+{
+    if(!flusher.joinable())
+        return;
+    stopping = true;
+    flusher.join();
+    //flusher drained every published block, the partial one is ours to write
+    if(fill)
+        writeChunk(blocks[produced % TRACE_BLOCKS], fill);
+    fill = 0;
+    out.close();
+}
+
+void TraceWriter::submit()
+{
+    if(!flusher.joinable())
+    {
+        fill = 0;   //not open, drop it
+        return;
+    }
+    produced++;
+    published.store(produced, memory_order_release);
+    //wait for the flusher to free the next block
+    while(produced - consumed.load(memory_order_acquire) >= TRACE_BLOCKS)
+        this_thread::yield();
+    fill = 0;
+}
+
+void TraceWriter::flushLoop()
+{
+    while(true)
+    {
+        unsigned long long done = consumed.load(memory_order_relaxed);
+        if(done < published.load(memory_order_acquire))
+        {
+            writeChunk(blocks[done % TRACE_BLOCKS], TRACE_BLOCK_RECORDS);
+            consumed.store(done + 1, memory_order_release);
+            continue;
+        }
+        if(stopping)
+        {
+            if(done == published.load(memory_order_acquire))
+                return;
+            continue;
+        }
+        this_thread::sleep_for(chrono::milliseconds(1));
+    }
+}
+
+void TraceWriter::writeChunk(const TraceRecord* records, int count)
+{
+    int rawSize = count * sizeof(TraceRecord);
+    int packedSize = -1;
+    if(compressed)
+        packedSize = lzCompress((const byte*)records, rawSize, packBuffer, lzBound(TRACE_BLOCK_BYTES));
+
+    putWord32(out, rawSize);
+    if(packedSize > 0 && packedSize < rawSize)
+    {
+        putWord32(out, packedSize);
+        out.write((const char*)packBuffer, packedSize);
+    }
+    else
+    {
+        putWord32(out, rawSize);
+        out.write((const char*)records, rawSize);
+    }
+}
+
+void TraceWriter::capture(TraceRecord& rec, CPU* cpu, unsigned long long cycle)
+{
+    MemoryController* mem = cpu->cpuMem;
+    unsigned short pc = cpu->PC;
+
+    rec.cycle = (unsigned int)cycle;
+    rec.pc = pc;
+    //peeks, so tracing doesn't add reads that I/O or the counters would see
+    rec.opCode = mem->peekByte(pc);
+    rec.operand[0] = mem->peekByte(pc + 1);
+    rec.operand[1] = mem->peekByte(pc + 2);
+    rec.A = cpu->A;
+    rec.X = cpu->X;
+    rec.Y = cpu->Y;
+    rec.SP = cpu->SP;
+    rec.P = cpu->statusByte();
+
+    //work out the effective address the same way the addressing helpers will
+    unsigned short word = rec.operand[0] | (rec.operand[1] << 8);
+    byte zp;
+    switch(getOpInfo(cpu->opSet)[rec.opCode].mode)
+    {
+    case IMM:
+        rec.address = pc + 1;
+        break;
+    case ZP:
+        rec.address = rec.operand[0];
+        break;
+    case ZPX:
+        rec.address = (rec.operand[0] + cpu->X) & 0xFF;
+        break;
+    case ZPY:
+        rec.address = (rec.operand[0] + cpu->Y) & 0xFF;
+        break;
+    case ABS:
+        rec.address = word;
+        break;
+    case ABX:
+        rec.address = word + cpu->X;
+        break;
+    case ABY:
+        rec.address = word + cpu->Y;
+        break;
+    case IND:
+        //NMOS jmpi() takes the high byte from $xx00 for a pointer at $xxFF
+        if((word & 0xFF) == 0xFF && cpu->opTable[rec.opCode] == &CPU::jmpi)
+            rec.address = mem->peekByte(word) | (mem->peekByte(word & 0xFF00) << 8);
+        else
+            rec.address = mem->peekByte(word) | (mem->peekByte(word + 1) << 8);
+        break;
+    case IDX:
+        zp = rec.operand[0] + cpu->X;
+        rec.address = mem->peekByte(zp) | (mem->peekByte((byte)(zp + 1)) << 8);
+        break;
+    case IDY:
+        zp = rec.operand[0];
+        rec.address = (mem->peekByte(zp) | (mem->peekByte((byte)(zp + 1)) << 8)) + cpu->Y;
+        break;
+    case IZP:
+        zp = rec.operand[0];
+        rec.address = mem->peekByte(zp) | (mem->peekByte((byte)(zp + 1)) << 8);
+        break;
+    case IAX:
+        word += cpu->X;
+        rec.address = mem->peekByte(word) | (mem->peekByte(word + 1) << 8);
+        break;
+    case REL:
+        rec.address = pc + 2 + (signed char)rec.operand[0];
+        break;
+    default:
+        rec.address = 0;
+        break;
+    }
+    recordCount++;
+}
@@ -0,0 +1,61 @@
+/**************************
+ * HEV6502 CPU Emulator
+ * TRACEWRITER.H
+ * Binary instruction trace sink. Records go into fixed blocks that a
+ * background thread compresses and writes out. One writer per CPU thread,
+ * the producer and the flusher never take a lock.
+ **************************/
+#ifndef TRACEWRITER_H
+#define TRACEWRITER_H
+
+#include <atomic>
+#include <thread>
+#include <fstream>
+#include <string>
+
+#include "tracerecord.h"
+#include "../cpu/cpu.h"
+#include "../cpu/opinfo.h"
+
+#define TRACE_BLOCK_RECORDS 4096    //records per block, 64K of data
+#define TRACE_BLOCKS        8       //blocks in flight between the CPU and the flusher
+
+using namespace std;
+
+class TraceWriter
+{
+public:
+    TraceWriter();
+    ~TraceWriter();
+    bool open(string fileName, bool compress = true, byte opSet = OPS_NMOS); //the CPU's opSet, for tracedump
+    void close();                   //flush everything and stop the flusher
+
+    //called before each instruction with PC on the opcode. cycle is the
+    //CPU's clock, currentClocks plus what the running loop hasn't added yet
+    void record(CPU* cpu, unsigned long long cycle)
+    {
+        if(fill == TRACE_BLOCK_RECORDS)
+            submit();
+        capture(blocks[produced % TRACE_BLOCKS][fill++], cpu, cycle);
+    }
+
+    unsigned long long recordCount;
+private:
+    void capture(TraceRecord& rec, CPU* cpu, unsigned long long cycle);
+    void submit();                  //hand the current block to the flusher
+    void flushLoop();
+    void writeChunk(const TraceRecord* records, int count);
+
+    TraceRecord* blocks[TRACE_BLOCKS];
+    int fill;                                   //records in the block being filled
+    unsigned long long produced;                //only written by the CPU thread
+    atomic<unsigned long long> published;       //blocks handed to the flusher
+    atomic<unsigned long long> consumed;        //blocks written out
+    atomic<bool> stopping;
+    thread flusher;
+    ofstream out;
+    bool compressed;
+    byte* packBuffer;
+};
+
+#endif // TRACEWRITER_H